@@ -0,0 +1,158 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_DISORDER_HPP_INCLUDED
+#define ISING_MODEL_DISORDER_HPP_INCLUDED
+
+#include "LatticeLayout.hpp"
+#include "Stencil.hpp"
+
+#include <cstdint>
+
+//===================//
+// Quenched Disorder //
+//===================//
+
+// Bond couplings J_ij and random field signs h_i take values in {-1, 0, +1}
+// (in units of interactivity and of random_field). The local field sum_j J_ij s_j
+// then keeps the [-NEIGHBOURS, +NEIGHBOURS] range of the pure model, and the
+// Metropolis table only gains a field class axis indexed by h_i + 1.
+//
+// Vacant sites hold spin 0: they drop out of every neighbour sum, and a "flip"
+// of a vacancy leaves it at 0, so the kernels need no extra branch for them.
+const int DISORDER_FIELD_CLASSES = 3;
+const int FIELD_CLASS_UNIFORM    = 1;
+
+struct DisorderParams
+{
+	float antiferro_fraction; // Share of J = -1 among present bonds (0.5 is the +-J spin glass)
+	float bond_dilution;      // Share of missing bonds (J = 0)
+	float site_dilution;      // Share of vacant sites
+	bool  random_field;       // Draw h_i = +-1 with equal probability
+};
+
+bool disorder_enabled(const DisorderParams& params)
+{
+	return params.antiferro_fraction > 0.0 || params.bond_dilution > 0.0 ||
+	       params.site_dilution      > 0.0 || params.random_field;
+}
+
+// Structure of arrays: bonds[N] is an int8 plane indexed exactly like the spin storage,
+// bonds[N][site] couples the site to its neighbour N. Both ends of a bond hold the same value.
+struct CouplingArrays
+{
+	const int8_t* bonds[STENCIL_MAX_NEIGHBOURS];
+	const int8_t* fields;
+};
+
+// Index of the offset pointing back along neighbour N (-1 if the stencil is not symmetric):
+template <typename Stencil>
+int stencil_opposite(int neighbour)
+{
+	for (int other = 0; other < Stencil::NEIGHBOURS; ++other)
+	{
+		bool opposite = true;
+		for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+		{
+			if (Stencil::OFFSETS[other][axis] != -Stencil::OFFSETS[neighbour][axis]) opposite = false;
+		}
+
+		if (opposite) return other;
+	}
+
+	return -1;
+}
+
+//=======================//
+// Weighted Stencil Sums //
+//=======================//
+
+// Sum of J_N * s_N over neighbours [0, N) of the site with storage index site:
+template <typename Stencil, int N>
+struct WeightedStencilSum
+{
+	static STENCIL_INLINE int sum(const char* points, const LayoutTables& tables, const int coords[LATTICE_MAX_DIMS],
+	                              int site, const CouplingArrays& couplings)
+	{
+		return WeightedStencilSum<Stencil, N - 1>::sum(points, tables, coords, site, couplings) +
+		       couplings.bonds[N - 1][site] * points[stencil_neighbour_index<Stencil, N - 1>(tables, coords)];
+	}
+};
+
+template <typename Stencil>
+struct WeightedStencilSum<Stencil, 0>
+{
+	static STENCIL_INLINE int sum(const char*, const LayoutTables&, const int*, int, const CouplingArrays&)
+	{
+		return 0;
+	}
+};
+
+// Helical counterpart, site is the linear index (which is also the storage index):
+template <typename Stencil, int N>
+struct WeightedHelicalSum
+{
+	static STENCIL_INLINE int sum(const char* points, const int* deltas, int site, const CouplingArrays& couplings)
+	{
+		return WeightedHelicalSum<Stencil, N - 1>::sum(points, deltas, site, couplings) +
+		       couplings.bonds[N - 1][site] * points[site + deltas[N - 1]];
+	}
+};
+
+template <typename Stencil>
+struct WeightedHelicalSum<Stencil, 0>
+{
+	static STENCIL_INLINE int sum(const char*, const int*, int, const CouplingArrays&)
+	{
+		return 0;
+	}
+};
+
+//===================//
+// Coupling Policies //
+//===================//
+
+// The sweep kernels are templated on one of these. The uniform policy ignores the
+// coupling arrays altogether, so the pure model compiles to the plain neighbour sum
+// and a constant field class.
+struct UniformCouplings
+{
+	template <typename Stencil>
+	static STENCIL_INLINE int neighbour_sum(const char* points, const LayoutTables& tables,
+	                                        const int coords[LATTICE_MAX_DIMS], int, const CouplingArrays&)
+	{
+		return StencilSum<Stencil, Stencil::NEIGHBOURS>::sum(points, tables, coords);
+	}
+
+	template <typename Stencil>
+	static STENCIL_INLINE int helical_sum(const char* points, const int* deltas, int site, const CouplingArrays&)
+	{
+		return HelicalSum<Stencil, Stencil::NEIGHBOURS>::sum(points + site, deltas);
+	}
+
+	static STENCIL_INLINE int field_class(int, const CouplingArrays&)
+	{
+		return FIELD_CLASS_UNIFORM;
+	}
+};
+
+struct DisorderedCouplings
+{
+	template <typename Stencil>
+	static STENCIL_INLINE int neighbour_sum(const char* points, const LayoutTables& tables,
+	                                        const int coords[LATTICE_MAX_DIMS], int site, const CouplingArrays& couplings)
+	{
+		return WeightedStencilSum<Stencil, Stencil::NEIGHBOURS>::sum(points, tables, coords, site, couplings);
+	}
+
+	template <typename Stencil>
+	static STENCIL_INLINE int helical_sum(const char* points, const int* deltas, int site, const CouplingArrays& couplings)
+	{
+		return WeightedHelicalSum<Stencil, Stencil::NEIGHBOURS>::sum(points, deltas, site, couplings);
+	}
+
+	static STENCIL_INLINE int field_class(int site, const CouplingArrays& couplings)
+	{
+		return couplings.fields[site] + 1;
+	}
+};
+
+#endif // ISING_MODEL_DISORDER_HPP_INCLUDED
@@ -0,0 +1,188 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_LATTICE_LAYOUT_HPP_INCLUDED
+#define ISING_MODEL_LATTICE_LAYOUT_HPP_INCLUDED
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+//================//
+// Memory Layouts //
+//================//
+
+// Lattices have up to four axes (x, y, z, w); unused axes have size 1.
+const int LATTICE_MAX_DIMS = 4;
+
+// Every supported layout is separable: the storage index of a site is
+//     offset[0][x] + offset[1][y] + offset[2][z] + offset[3][w]
+// so a layout is fully described by per-axis offset tables.
+enum LatticeLayout
+{
+	LAYOUT_ROW_MAJOR = 0,
+	LAYOUT_MORTON    = 1,
+	LAYOUT_BRICK     = 2
+};
+
+const char* lattice_layout_name(LatticeLayout layout)
+{
+	switch (layout)
+	{
+		case LAYOUT_ROW_MAJOR: return "row_major";
+		case LAYOUT_MORTON:    return "morton";
+		case LAYOUT_BRICK:     return "brick";
+	}
+
+	return "unknown";
+}
+
+bool parse_lattice_layout(const char* name, LatticeLayout* layout)
+{
+	if (name == nullptr || layout == nullptr) return false;
+
+	if (strcmp(name, "row_major") == 0) { *layout = LAYOUT_ROW_MAJOR; return true; }
+	if (strcmp(name, "morton"   ) == 0) { *layout = LAYOUT_MORTON;    return true; }
+	if (strcmp(name, "brick"    ) == 0) { *layout = LAYOUT_BRICK;     return true; }
+
+	return false;
+}
+
+// Bricks are 4x4x4 = 64 sites, exactly one 64-byte cache line of spins.
+// Axes of size 1 get a brick edge of 1, so 2D lattices use 4x4 bricks:
+const int LAYOUT_BRICK_EDGE = 4;
+
+//========================//
+// Per-Axis Offset Tables //
+//========================//
+
+// Tables hold one wrapped halo entry on each side:
+// table[0] is coordinate -1 and table[size + 1] is coordinate size.
+// This lets neighbour lookups skip the modulo on periodic wraps.
+struct LayoutTables
+{
+	int* offsets[LATTICE_MAX_DIMS];
+
+	size_t storage_size;
+};
+
+int layout_bits_for(int size)
+{
+	int bits = 0;
+	while ((1 << bits) < size) ++bits;
+	return bits;
+}
+
+LayoutTables build_layout_tables(LatticeLayout layout, const int sizes[LATTICE_MAX_DIMS])
+{
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+	{
+		if (sizes[axis] <= 0)
+		{
+			throw std::invalid_argument("build_layout_tables(): Lattice sizes must be positive");
+		}
+	}
+
+	LayoutTables tables;
+	int* tabs[LATTICE_MAX_DIMS];
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+	{
+		tables.offsets[axis] = new int[sizes[axis] + 2];
+		tabs[axis] = tables.offsets[axis] + 1;
+	}
+
+	switch (layout)
+	{
+		case LAYOUT_ROW_MAJOR:
+		case LAYOUT_BRICK:
+		{
+			// Row-major is the degenerate brick layout with 1x1x1x1 bricks.
+			// The last axis is the fastest both inside a brick and between bricks.
+			int edges [LATTICE_MAX_DIMS];
+			int bricks[LATTICE_MAX_DIMS];
+			for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+			{
+				edges [axis] = (layout == LAYOUT_BRICK && sizes[axis] > 1)? LAYOUT_BRICK_EDGE : 1;
+				bricks[axis] = (sizes[axis] + edges[axis] - 1) / edges[axis];
+			}
+
+			int brick_volume = 1;
+			for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis) brick_volume *= edges[axis];
+
+			int local_stride = 1;
+			int brick_stride = brick_volume;
+			for (int axis = LATTICE_MAX_DIMS - 1; axis >= 0; --axis)
+			{
+				for (int c = 0; c < sizes[axis]; ++c)
+				{
+					tabs[axis][c] = (c / edges[axis]) * brick_stride + (c % edges[axis]) * local_stride;
+				}
+
+				local_stride *= edges [axis];
+				brick_stride *= bricks[axis];
+			}
+
+			tables.storage_size = brick_stride;
+			break;
+		}
+		case LAYOUT_MORTON:
+		{
+			// Interleave coordinate bits round-robin (the last axis is the fastest).
+			// Axes with fewer bits simply drop out of the interleaving once exhausted,
+			// so non-cubic lattices do not waste more than the power-of-two padding.
+			int bits[LATTICE_MAX_DIMS];
+			int max_bits = 0;
+			for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+			{
+				bits[axis] = layout_bits_for(sizes[axis]);
+				if (bits[axis] > max_bits) max_bits = bits[axis];
+
+				for (int c = 0; c < sizes[axis]; ++c) tabs[axis][c] = 0;
+			}
+
+			int out_bit = 0;
+			for (int bit = 0; bit < max_bits; ++bit)
+			{
+				for (int axis = LATTICE_MAX_DIMS - 1; axis >= 0; --axis)
+				{
+					if (bit >= bits[axis]) continue;
+
+					for (int c = 0; c < sizes[axis]; ++c)
+					{
+						if (c & (1 << bit)) tabs[axis][c] |= 1 << out_bit;
+					}
+
+					++out_bit;
+				}
+			}
+
+			tables.storage_size = static_cast<size_t>(1) << out_bit;
+			break;
+		}
+		default:
+		{
+			for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis) delete[] tables.offsets[axis];
+			throw std::invalid_argument("build_layout_tables(): Unknown layout");
+		}
+	}
+
+	// Fill in the periodic halo:
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+	{
+		tabs[axis][-1]          = tabs[axis][sizes[axis] - 1];
+		tabs[axis][sizes[axis]] = tabs[axis][0];
+	}
+
+	return tables;
+}
+
+void destroy_layout_tables(LayoutTables* tables)
+{
+	if (tables == nullptr) return;
+
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+	{
+		delete[] tables->offsets[axis];
+		tables->offsets[axis] = nullptr;
+	}
+}
+
+#endif // ISING_MODEL_LATTICE_LAYOUT_HPP_INCLUDED
@@ -3,141 +3,1283 @@
 #define ISING_MODEL_STATE_GRAPH_HPP_INCLUDED
 
 #include "ThreadCoreScalability.hpp"
+#include "LatticeLayout.hpp"
+#include "Stencil.hpp"
+#include "Disorder.hpp"
+#include "WangLandau.hpp"
 
 #include <random>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <stdexcept>
+#include <vector>
+
+//=====================//
+// Spin Initialization //
+//=====================//
+
+enum LatticeStart
+{
+	START_RANDOM    = 0, // Infinite temperature
+	START_COLD_UP   = 1, // All spins +1
+	START_COLD_DOWN = 2, // All spins -1
+	START_BIASED    = 3  // Spin +1 with probability bias
+};
+
+const char* lattice_start_name(LatticeStart start)
+{
+	switch (start)
+	{
+		case START_RANDOM:    return "random";
+		case START_COLD_UP:   return "cold_up";
+		case START_COLD_DOWN: return "cold_down";
+		case START_BIASED:    return "biased";
+	}
+
+	return "unknown";
+}
+
+bool parse_lattice_start(const char* name, LatticeStart* start)
+{
+	if (name == nullptr || start == nullptr) return false;
+
+	if (strcmp(name, "random"   ) == 0) { *start = START_RANDOM;    return true; }
+	if (strcmp(name, "cold_up"  ) == 0) { *start = START_COLD_UP;   return true; }
+	if (strcmp(name, "cold_down") == 0) { *start = START_COLD_DOWN; return true; }
+	if (strcmp(name, "biased"   ) == 0) { *start = START_BIASED;    return true; }
+
+	return false;
+}
+
+// SplitMix64: an add and two multiply-xorshift rounds per 64 bits, plenty for initial states:
+struct SpinFillGenerator
+{
+	uint64_t state;
+
+	explicit SpinFillGenerator(uint64_t seed) : state(seed) {}
+
+	uint64_t next()
+	{
+		state += 0x9E3779B97F4A7C15ULL;
+
+		uint64_t mixed = state;
+		mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+		return mixed ^ (mixed >> 31);
+	}
+};
+
+// Eight spin bytes for every byte of random bits, least significant bit first, bit set for spin +1:
+struct SpinExpansionTable
+{
+	uint64_t spins[256];
+
+	SpinExpansionTable()
+	{
+		for (int bits = 0; bits < 256; ++bits)
+		{
+			char bytes[8];
+			for (int bit = 0; bit < 8; ++bit) bytes[bit] = (bits >> bit) & 1? 1 : -1;
+
+			memcpy(&spins[bits], bytes, 8);
+		}
+	}
+};
+
+//====================//
+// N-Fold Way Classes //
+//====================//
+
+// Class of the sites kept out of the n-fold buckets (above every real class index):
+const uint8_t NFOLD_VACANCY = 255;
 
 class Lattice
 {
 private:
 	// Computation parameters:
-	int size_x, size_y, size_z;
+	int size_x, size_y, size_z, size_w;
+	int sizes[LATTICE_MAX_DIMS];
+	int num_sites;
+	Geometry geometry;
+	LatticeLayout layout;
+	Boundary boundary;
+	LayoutTables tables;
+
+	// Helical boundaries: linear neighbour offsets and ghost sites on both ends of the storage:
+	int helical_deltas[STENCIL_MAX_NEIGHBOURS];
+	int helical_padding;
+
+	// Points to site 0, after the ghost sites:
+	char* storage;
 	char* points;
 
 	// Random number generation:
 	std::random_device rd;
 	std::mt19937 gen;
-	std::uniform_int_distribution<int64_t> ints;
+	std::uniform_int_distribution<uint32_t> sites;
 	std::uniform_real_distribution<float> floats;
 
+	// Metropolis acceptance table, indexed by [field class][spin > 0][neighbour_sum + NEIGHBOURS]:
+	float acceptance[DISORDER_FIELD_CLASSES][2][2 * STENCIL_MAX_NEIGHBOURS + 1];
+	float acceptance_interactivity;
+	float acceptance_temperature;
+	float acceptance_field;
+	float acceptance_random_field;
+
+	// Quenched disorder: coupling planes, random field signs and vacant storage indices.
+	// Pure lattices leave them empty and run the UniformCouplings kernels:
+	bool disordered;
+	bool random_fields;
+	std::vector<int8_t> bond_storage;
+	std::vector<int8_t> field_storage;
+	CouplingArrays couplings;
+	std::vector<int> vacancies;
+
+	// Tiled sweep position (kept between calls), a linear site for helical boundaries:
+	int tile_cursor;
+
+	// N-fold way: sites bucketed by class [field class][spin > 0][neighbour_sum + NEIGHBOURS] (the acceptance table index).
+	// Sites are row-major linear indices; every site knows its class and its position in the class bucket.
+	std::vector<int> nfold_members[DISORDER_FIELD_CLASSES][2][2 * STENCIL_MAX_NEIGHBOURS + 1];
+	std::vector<uint8_t> nfold_class;
+	std::vector<int> nfold_position;
+	bool nfold_valid;
+
+	void random_site(int coords[LATTICE_MAX_DIMS]);
+
+	template <typename Stencil>
+	void prepare_acceptance();
+
+	// Kernels are shared by pure and disordered lattices through the Couplings policy (see Disorder.hpp):
+	// Updates return whether a spin was flipped, sweeps return the number of flips:
+	template <typename Stencil, typename Couplings>
+	bool metropolis_update(const int coords[LATTICE_MAX_DIMS], std::mt19937& update_gen,
+	                       std::uniform_real_distribution<float>& update_floats);
+
+	template <typename Stencil, typename Couplings>
+	bool metropolis_update_helical(int site);
+
+	void mirror_helical_ghost(int site);
+
+	template <typename Stencil, typename Couplings>
+	uint64_t metropolis_sweep_kernel(unsigned steps);
+
+	template <typename Stencil, typename Couplings>
+	uint64_t metropolis_sweep_tiled_kernel(unsigned steps);
+
+	template <typename Stencil, typename Couplings>
+	uint64_t metropolis_sweep_slab_kernel(int x_begin, int x_end, unsigned steps, std::mt19937& slab_gen);
+
+	template <typename Stencil, typename Couplings>
+	uint64_t metropolis_sweep_helical(unsigned steps);
+
+	template <typename Stencil, typename Couplings>
+	uint64_t metropolis_sweep_sequential_helical(unsigned steps);
+
+	int storage_index(int site) const;
+
+	template <typename Stencil, typename Couplings>
+	int site_neighbour_sum(int site) const;
+
+	template <typename Stencil>
+	void site_neighbours(int site, int neighbours[Stencil::NEIGHBOURS]) const;
+
+	template <typename Stencil, typename Couplings>
+	void nfold_rebuild();
+
+	template <typename Stencil, typename Couplings>
+	void nfold_update_class(int site);
+
+	template <typename Stencil, typename Couplings>
+	uint64_t nfold_sweep_kernel(unsigned steps);
+
+	template <typename Stencil, typename Couplings>
+	void wang_landau_sweep_kernel(WangLandauWalker& walker, unsigned steps);
+
+	template <typename Stencil, typename Couplings>
+	int calculate_bond_sum_kernel() const;
+
+	template <typename Stencil>
+	void generate_disorder_stencil(const DisorderParams& params, uint32_t seed);
+
 public:
 	// Computation parameters:
 	float interactivity;
 	float temperature;
 	float field;
+	float random_field; // Amplitude of the random fields h_i, same units as field
 
 	// Methods:
-	Lattice(int sz_x, int sz_y, int sz_z, float iact, float temp, float fld);
+	Lattice(int sz_x, int sz_y, int sz_z, float iact, float temp, float fld,
+	        LatticeLayout lay = LAYOUT_ROW_MAJOR, Geometry geom = GEOMETRY_SIMPLE_CUBIC, int sz_w = 1,
+	        Boundary bound = BOUNDARY_PERIODIC);
 	~Lattice();
 
+	// Spins are undefined until one of the initializations below. The constructor leaves the storage
+	// untouched, so its pages are first touched (and placed) by the threads filling their chunks:
 	void init_with_randoms();
+	void init_spins(LatticeStart start, float bias = 0.5);
+
+	// Bulk fill split between threads: each fills chunk [0, num_chunks) of the storage (cache line
+	// aligned) from its own seed, then a single thread calls init_spins_finish() to empty the
+	// vacancies and refresh the ghosts. init_spins() is the single-chunk case:
+	void init_spins_chunk(LatticeStart start, float bias, uint64_t seed, int chunk, int num_chunks);
+	void init_spins_finish();
+
+	// Must follow any write through get(): refreshes helical ghosts and drops the n-fold buckets:
+	void spins_changed();
+
+	// Draws a disorder realization (reproducible for a given seed) and empties the vacant sites.
+	// A lattice without any disorder keeps the pure kernels:
+	void generate_disorder(const DisorderParams& params, uint32_t seed);
+	void clear_disorder();
+	bool is_disordered() const;
+
+	LatticeLayout get_layout() const;
+	Geometry get_geometry() const;
+	Boundary get_boundary() const;
+	size_t storage_size() const;
+	int get_num_sites() const;
+	void get_sizes(int sz[LATTICE_MAX_DIMS]) const;
+
+	// Raw storage: site (x, y, z, w) lives at sum of offsets[axis][coord + 1] (tables include the halo):
+	const char* data() const;
+	const LayoutTables& get_layout_tables() const;
 
 	char& get(int x, int y, int z) const;
-	void metropolis_sweep(unsigned steps);
+	char& get(int x, int y, int z, int w) const;
+
+	// Dispatch to the stencil instantiation of the lattice geometry, return the number of flips:
+	uint64_t metropolis_sweep(unsigned steps);
+	uint64_t metropolis_sweep_tiled(unsigned steps);
+
+	template <typename Stencil>
+	uint64_t metropolis_sweep_stencil(unsigned steps);
+
+	template <typename Stencil>
+	uint64_t metropolis_sweep_tiled_stencil(unsigned steps);
+
+	// Thread teams: prepare_slab_sweeps() runs on one thread, after which several threads may sweep
+	// x-slabs [x_begin, x_end) concurrently, each with its own generator and distributions, as long
+	// as no two of the slabs are adjacent. Periodic boundaries only:
+	void prepare_slab_sweeps();
+	uint64_t metropolis_sweep_slab(int x_begin, int x_end, unsigned steps, std::mt19937& slab_gen);
+
+	template <typename Stencil>
+	uint64_t metropolis_sweep_slab_stencil(int x_begin, int x_end, unsigned steps, std::mt19937& slab_gen);
+
+	// Rejection-free n-fold way (BKL): every event flips a spin, and the time is
+	// advanced by the number of Metropolis steps that would have passed meanwhile:
+	uint64_t nfold_sweep(unsigned steps);
+
+	template <typename Stencil>
+	uint64_t nfold_sweep_stencil(unsigned steps);
+
+	// Flat-histogram walk in (bond sum, total spin), temperature and field play no part.
+	// The walker must have been started at the current bond and spin sums:
+	void wang_landau_sweep(WangLandauWalker& walker, unsigned steps);
+
+	template <typename Stencil>
+	void wang_landau_sweep_stencil(WangLandauWalker& walker, unsigned steps);
 
 	float calculate_average_spin() const;
+
+	// Integer observables for histograms: sum of J_ij s_i s_j over bonds and sum of s_i:
+	int calculate_bond_sum() const;
+	int calculate_total_spin() const;
+
+	template <typename Stencil>
+	int calculate_bond_sum_stencil() const;
+
+	// Canonical (x, y, z, w) row-major bit packing, least significant bit first, bit set for spin +1
+	// (vacancies are packed as clear bits):
+	void pack_spins(uint8_t* packed) const;
 };
 
 Lattice::Lattice(
 	int sz_x, int sz_y, int sz_z,
 	float iact,
 	float temp,
-	float fld
+	float fld,
+	LatticeLayout lay,
+	Geometry geom,
+	int sz_w,
+	Boundary bound
 ) :
 	size_x        (sz_x),
 	size_y        (sz_y),
 	size_z        (sz_z),
-	points        (new char[sz_x * sz_y * sz_z + CACHE_LINE_SIZE]),
+	size_w        (sz_w),
+	sizes         {sz_x, sz_y, sz_z, sz_w},
+	num_sites     (sz_x * sz_y * sz_z * sz_w),
+	geometry      (geom),
+	layout        (lay),
+	boundary      (bound),
+	tables        (build_layout_tables(lay, sizes)),
+	helical_padding (bound == BOUNDARY_HELICAL? geometry_helical_deltas(geom, sizes, helical_deltas) : 0),
+	storage       (new char[tables.storage_size + 2 * helical_padding + CACHE_LINE_SIZE]),
+	points        (storage + helical_padding),
 	gen           (std::mt19937(rd())),
-	ints          (std::uniform_int_distribution<int64_t>(0, 1 << 31)),
+	sites         (std::uniform_int_distribution<uint32_t>(0, num_sites - 1)),
 	floats        (std::uniform_real_distribution<float>(0.0, 1.0)),
+	acceptance_interactivity (NAN),
+	acceptance_temperature   (NAN),
+	acceptance_field         (NAN),
+	acceptance_random_field  (NAN),
+	disordered    (false),
+	random_fields (false),
+	couplings     (),
+	tile_cursor   (0),
+	nfold_valid   (false),
 	interactivity (iact),
 	temperature   (temp),
-	field         (fld )
+	field         (fld ),
+	random_field  (0.0 )
 {
-	if (points == nullptr)
+	if (storage == nullptr)
 	{
 		throw std::runtime_error("Lattice::Lattice(): Unable to allocate memory");
 	}
+
+	// Axes beyond the geometry dimensionality must be collapsed:
+	int dims = geometry_dimensions(geometry);
+	for (int axis = dims; axis < LATTICE_MAX_DIMS; ++axis)
+	{
+		if (sizes[axis] != 1)
+		{
+			destroy_layout_tables(&tables);
+			delete[] storage;
+			throw std::invalid_argument("Lattice::Lattice(): Lattice size does not match geometry dimensionality");
+		}
+	}
+
+	// A single wrap through the ghost sites needs a row-major chain longer than the stencil reach:
+	if (boundary == BOUNDARY_HELICAL && (layout != LAYOUT_ROW_MAJOR || helical_padding > num_sites))
+	{
+		destroy_layout_tables(&tables);
+		delete[] storage;
+		throw std::invalid_argument("Lattice::Lattice(): Helical boundaries require a row-major layout "
+		                            "longer than the stencil reach");
+	}
 }
 
 void Lattice::init_with_randoms()
 {
-	int cur_bit = 0;
-	int cur_rand = 0;
-	for (int x = 0; x < size_x; ++x) {
-	for (int y = 0; y < size_y; ++y) {
-	for (int z = 0; z < size_z; ++z) {
-		if (cur_bit == 0)
+	init_spins(START_RANDOM);
+}
+
+void Lattice::init_spins(LatticeStart start, float bias)
+{
+	uint64_t seed = (static_cast<uint64_t>(gen()) << 32) | gen();
+
+	init_spins_chunk(start, bias, seed, 0, 1);
+	init_spins_finish();
+}
+
+// Fills whole storage bytes, padding sites of Morton/brick layouts included (they are never read).
+// Random starts expand 64 random bits into 64 spins through the table, biased starts compare
+// 16 random bits per spin against the bias (so the bias has a resolution of 2^-16):
+void Lattice::init_spins_chunk(LatticeStart start, float bias, uint64_t seed, int chunk, int num_chunks)
+{
+	if (!(bias >= 0.0 && bias <= 1.0))
+	{
+		throw std::invalid_argument("Lattice::init_spins(): Bias must lie in [0, 1]");
+	}
+
+	if (chunk < 0 || chunk >= num_chunks)
+	{
+		throw std::invalid_argument("Lattice::init_spins(): Chunk is out of range");
+	}
+
+	size_t first = (tables.storage_size * chunk       / num_chunks) & ~static_cast<size_t>(CACHE_LINE_SIZE - 1);
+	size_t last  = (tables.storage_size * (chunk + 1) / num_chunks) & ~static_cast<size_t>(CACHE_LINE_SIZE - 1);
+	if (chunk == num_chunks - 1) last = tables.storage_size;
+	if (last <= first) return;
+
+	char*  spins = points + first;
+	size_t count = last - first;
+
+	// Chunks of one fill draw from decorrelated streams:
+	SpinFillGenerator fill_gen(seed ^ (0xD1B54A32D192ED03ULL * (chunk + 1)));
+
+	switch (start)
+	{
+		case START_COLD_UP:
+		{
+			memset(spins, 1, count);
+			break;
+		}
+		case START_COLD_DOWN:
 		{
-			cur_bit = 1;
-			cur_rand = ints(rd);
+			memset(spins, -1, count);
+			break;
 		}
+		case START_RANDOM:
+		{
+			static const SpinExpansionTable expansion;
 
-		points[(x*size_y + y)*size_z + z] = (cur_rand & cur_bit)? 1 : -1;
+			size_t cur = 0;
+			for (; cur + 64 <= count; cur += 64)
+			{
+				uint64_t bits = fill_gen.next();
+				for (int byte = 0; byte < 8; ++byte)
+				{
+					memcpy(spins + cur + 8 * byte, &expansion.spins[(bits >> (8 * byte)) & 0xFF], 8);
+				}
+			}
 
-		cur_bit = cur_bit << 1;
-	}}}
+			uint64_t bits = fill_gen.next();
+			for (int bit = 0; cur < count; ++cur, ++bit) spins[cur] = (bits >> bit) & 1? 1 : -1;
+
+			break;
+		}
+		case START_BIASED:
+		{
+			// Random words are drawn into a buffer first, so the comparison loop vectorizes:
+			uint32_t threshold = static_cast<uint32_t>(bias * 65536.0 + 0.5);
+			uint16_t draws[1024];
+
+			for (size_t cur = 0; cur < count; cur += 1024)
+			{
+				size_t block = std::min<size_t>(1024, count - cur);
+				for (size_t word = 0; word < (block + 3) / 4; ++word)
+				{
+					uint64_t bits = fill_gen.next();
+					memcpy(&draws[4 * word], &bits, sizeof(bits));
+				}
+
+				for (size_t spin = 0; spin < block; ++spin)
+				{
+					spins[cur + spin] = draws[spin] < threshold? 1 : -1;
+				}
+			}
+
+			break;
+		}
+	}
+}
+
+void Lattice::init_spins_finish()
+{
+	for (int index : vacancies) points[index] = 0;
+
+	spins_changed();
+}
+
+// Ghosts before site 0 mirror the tail of the chain, ghosts after the last site mirror its head:
+void Lattice::spins_changed()
+{
+	nfold_valid = false;
+
+	if (boundary != BOUNDARY_HELICAL) return;
+
+	std::copy(points + num_sites - helical_padding, points + num_sites, points - helical_padding);
+	std::copy(points, points + helical_padding, points + num_sites);
 }
 
 Lattice::~Lattice()
 {
-	if (points != nullptr) delete[] points;
-	points = nullptr;
+	if (storage != nullptr) delete[] storage;
+	storage = nullptr;
+	points  = nullptr;
+
+	destroy_layout_tables(&tables);
+}
+
+LatticeLayout Lattice::get_layout() const
+{
+	return layout;
+}
+
+Geometry Lattice::get_geometry() const
+{
+	return geometry;
+}
+
+Boundary Lattice::get_boundary() const
+{
+	return boundary;
+}
+
+size_t Lattice::storage_size() const
+{
+	return tables.storage_size;
+}
+
+int Lattice::get_num_sites() const
+{
+	return num_sites;
+}
+
+void Lattice::get_sizes(int sz[LATTICE_MAX_DIMS]) const
+{
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis) sz[axis] = sizes[axis];
+}
+
+const char* Lattice::data() const
+{
+	return points;
+}
+
+const LayoutTables& Lattice::get_layout_tables() const
+{
+	return tables;
 }
 
 inline char& Lattice::get(int x, int y, int z) const
+{
+	return get(x, y, z, 0);
+}
+
+inline char& Lattice::get(int x, int y, int z, int w) const
 {
 	int fixed_x = (x + size_x) % size_x;
 	int fixed_y = (y + size_y) % size_y;
 	int fixed_z = (z + size_z) % size_z;
+	int fixed_w = (w + size_w) % size_w;
+
+	return points[tables.offsets[0][fixed_x + 1] + tables.offsets[1][fixed_y + 1] +
+	              tables.offsets[2][fixed_z + 1] + tables.offsets[3][fixed_w + 1]];
+}
+
+inline void Lattice::random_site(int coords[LATTICE_MAX_DIMS])
+{
+	uint32_t random_num = sites(gen);
+
+	coords[3] = random_num % size_w;
+	random_num /= size_w;
+	coords[2] = random_num % size_z;
+	random_num /= size_z;
+	coords[1] = random_num % size_y;
+	random_num /= size_y;
+	coords[0] = random_num;
+}
+
+// The local field only takes 2*NEIGHBOURS + 1 values per field class, so the exp()
+// is evaluated once per parameter change instead of once per step:
+template <typename Stencil>
+void Lattice::prepare_acceptance()
+{
+	if (acceptance_interactivity == interactivity &&
+	    acceptance_temperature   == temperature   &&
+	    acceptance_field         == field         &&
+	    acceptance_random_field  == random_field) return;
+
+	for (int field_class = 0; field_class < DISORDER_FIELD_CLASSES; ++field_class)
+	{
+		float site_field = field + (field_class - FIELD_CLASS_UNIFORM) * random_field;
+		for (int spin_up = 0; spin_up < 2; ++spin_up)
+		{
+			int cur_spin = spin_up? 1 : -1;
+			for (int neighbour_sum = -Stencil::NEIGHBOURS; neighbour_sum <= Stencil::NEIGHBOURS; ++neighbour_sum)
+			{
+				float interaction_vector = site_field + interactivity * neighbour_sum;
+				float cur_energy = -interaction_vector * cur_spin;
+
+				acceptance[field_class][spin_up][neighbour_sum + Stencil::NEIGHBOURS] =
+					(cur_energy > 0)? 1.0 : exp(2.0 * cur_energy / temperature);
+			}
+		}
+	}
+
+	acceptance_interactivity = interactivity;
+	acceptance_temperature   = temperature;
+	acceptance_field         = field;
+	acceptance_random_field  = random_field;
+}
+
+// Coordinates must lie in [0, size): the offset tables handle the periodic wrap
+// of the neighbours, so no modulo and no index re-encoding is needed here.
+template <typename Stencil, typename Couplings>
+inline bool Lattice::metropolis_update(const int coords[LATTICE_MAX_DIMS], std::mt19937& update_gen,
+                                       std::uniform_real_distribution<float>& update_floats)
+{
+	int site = tables.offsets[0][coords[0] + 1] + tables.offsets[1][coords[1] + 1] +
+	           tables.offsets[2][coords[2] + 1] + tables.offsets[3][coords[3] + 1];
+	char& cur_spin = points[site];
+
+	int neighbour_sum = Couplings::template neighbour_sum<Stencil>(points, tables, coords, site, couplings);
+
+	float acceptance_ratio =
+		acceptance[Couplings::field_class(site, couplings)][cur_spin > 0][neighbour_sum + Stencil::NEIGHBOURS];
+
+	// Vacancies accept every move, but never flip:
+	if (acceptance_ratio >= 1.0 || update_floats(update_gen) < acceptance_ratio)
+	{
+		cur_spin = -cur_spin;
+		return cur_spin != 0;
+	}
+
+	return false;
+}
+
+// Site is the row-major linear index in [0, num_sites):
+template <typename Stencil, typename Couplings>
+inline bool Lattice::metropolis_update_helical(int site)
+{
+	char& cur_spin = points[site];
+
+	int neighbour_sum = Couplings::template helical_sum<Stencil>(points, helical_deltas, site, couplings);
+
+	float acceptance_ratio =
+		acceptance[Couplings::field_class(site, couplings)][cur_spin > 0][neighbour_sum + Stencil::NEIGHBOURS];
+
+	if (acceptance_ratio >= 1.0 || floats(gen) < acceptance_ratio)
+	{
+		cur_spin = -cur_spin;
+		mirror_helical_ghost(site);
+		return cur_spin != 0;
+	}
+
+	return false;
+}
+
+// Only flips pay for the wrap. A site may have two ghosts on tiny lattices:
+inline void Lattice::mirror_helical_ghost(int site)
+{
+	if (site <  helical_padding)             points[site + num_sites] = points[site];
+	if (site >= num_sites - helical_padding) points[site - num_sites] = points[site];
+}
+
+template <typename Stencil, typename Couplings>
+uint64_t Lattice::metropolis_sweep_helical(unsigned steps)
+{
+	uint64_t flips = 0;
+	for (unsigned i = 0; i < steps; ++i)
+	{
+		flips += metropolis_update_helical<Stencil, Couplings>(sites(gen));
+	}
+
+	return flips;
+}
+
+// Tiles of a helical lattice degenerate into one typewriter pass over the chain:
+template <typename Stencil, typename Couplings>
+uint64_t Lattice::metropolis_sweep_sequential_helical(unsigned steps)
+{
+	uint64_t flips = 0;
+	for (unsigned i = 0; i < steps; ++i)
+	{
+		flips += metropolis_update_helical<Stencil, Couplings>(tile_cursor);
+
+		tile_cursor += 1;
+		if (tile_cursor == num_sites) tile_cursor = 0;
+	}
+
+	return flips;
+}
+
+// The coupling policy is chosen once per sweep, never per step:
+template <typename Stencil>
+uint64_t Lattice::metropolis_sweep_stencil(unsigned steps)
+{
+	prepare_acceptance<Stencil>();
+	nfold_valid = false;
 
-	return points[(fixed_x*size_y + fixed_y)*size_z + fixed_z];
+	if (disordered) return metropolis_sweep_kernel<Stencil, DisorderedCouplings>(steps);
+	else            return metropolis_sweep_kernel<Stencil, UniformCouplings   >(steps);
 }
 
-void Lattice::metropolis_sweep(unsigned steps)
+template <typename Stencil, typename Couplings>
+uint64_t Lattice::metropolis_sweep_kernel(unsigned steps)
 {
+	if (boundary == BOUNDARY_HELICAL) return metropolis_sweep_helical<Stencil, Couplings>(steps);
+
+	uint64_t flips = 0;
+	int coords[LATTICE_MAX_DIMS];
 	for (unsigned i = 0; i < steps; ++i)
 	{
-		int random_num = ints(rd);
+		random_site(coords);
+
+		flips += metropolis_update<Stencil, Couplings>(coords, gen, floats);
+	}
+
+	return flips;
+}
 
-		int altered_z = (size_z + random_num) % size_z;
+// Visits sites in brick-sized tiles instead of at random.
+// Used to compare layouts on a cache-friendly access pattern:
+template <typename Stencil>
+uint64_t Lattice::metropolis_sweep_tiled_stencil(unsigned steps)
+{
+	prepare_acceptance<Stencil>();
+	nfold_valid = false;
+
+	if (disordered) return metropolis_sweep_tiled_kernel<Stencil, DisorderedCouplings>(steps);
+	else            return metropolis_sweep_tiled_kernel<Stencil, UniformCouplings   >(steps);
+}
+
+template <typename Stencil, typename Couplings>
+uint64_t Lattice::metropolis_sweep_tiled_kernel(unsigned steps)
+{
+	if (boundary == BOUNDARY_HELICAL) return metropolis_sweep_sequential_helical<Stencil, Couplings>(steps);
+
+	int edges[LATTICE_MAX_DIMS];
+	int tiles[LATTICE_MAX_DIMS];
+	int num_tiles = 1;
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+	{
+		edges[axis] = sizes[axis] > 1? LAYOUT_BRICK_EDGE : 1;
+		tiles[axis] = (sizes[axis] + edges[axis] - 1) / edges[axis];
+		num_tiles *= tiles[axis];
+	}
+
+	uint64_t flips = 0;
+	unsigned done = 0;
+	while (done < steps)
+	{
+		int tile = tile_cursor;
+		tile_cursor = (tile_cursor + 1) % num_tiles;
+
+		int begin[LATTICE_MAX_DIMS];
+		int end  [LATTICE_MAX_DIMS];
+		for (int axis = LATTICE_MAX_DIMS - 1; axis >= 0; --axis)
+		{
+			begin[axis] = (tile % tiles[axis]) * edges[axis];
+			end  [axis] = std::min(begin[axis] + edges[axis], sizes[axis]);
+			tile /= tiles[axis];
+		}
+
+		int coords[LATTICE_MAX_DIMS];
+		for (coords[0] = begin[0]; coords[0] < end[0]; ++coords[0]) {
+		for (coords[1] = begin[1]; coords[1] < end[1]; ++coords[1]) {
+		for (coords[2] = begin[2]; coords[2] < end[2]; ++coords[2]) {
+		for (coords[3] = begin[3]; coords[3] < end[3]; ++coords[3]) {
+			if (done == steps) return flips;
+
+			flips += metropolis_update<Stencil, Couplings>(coords, gen, floats);
+			done += 1;
+		}}}}
+	}
+
+	return flips;
+}
+
+//=============//
+// Slab Sweeps //
+//=============//
+
+void Lattice::prepare_slab_sweeps()
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        prepare_acceptance<SquareStencil           >(); break;
+		case GEOMETRY_TRIANGULAR:    prepare_acceptance<TriangularStencil       >(); break;
+		case GEOMETRY_SIMPLE_CUBIC:  prepare_acceptance<SimpleCubicStencil      >(); break;
+		case GEOMETRY_BCC:           prepare_acceptance<BodyCenteredCubicStencil>(); break;
+		case GEOMETRY_FCC:           prepare_acceptance<FaceCenteredCubicStencil>(); break;
+		case GEOMETRY_HYPERCUBIC_4D: prepare_acceptance<Hypercubic4DStencil     >(); break;
+	}
+
+	nfold_valid = false;
+}
+
+uint64_t Lattice::metropolis_sweep_slab(int x_begin, int x_end, unsigned steps, std::mt19937& slab_gen)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return metropolis_sweep_slab_stencil<SquareStencil           >(x_begin, x_end, steps, slab_gen);
+		case GEOMETRY_TRIANGULAR:    return metropolis_sweep_slab_stencil<TriangularStencil       >(x_begin, x_end, steps, slab_gen);
+		case GEOMETRY_SIMPLE_CUBIC:  return metropolis_sweep_slab_stencil<SimpleCubicStencil      >(x_begin, x_end, steps, slab_gen);
+		case GEOMETRY_BCC:           return metropolis_sweep_slab_stencil<BodyCenteredCubicStencil>(x_begin, x_end, steps, slab_gen);
+		case GEOMETRY_FCC:           return metropolis_sweep_slab_stencil<FaceCenteredCubicStencil>(x_begin, x_end, steps, slab_gen);
+		case GEOMETRY_HYPERCUBIC_4D: return metropolis_sweep_slab_stencil<Hypercubic4DStencil     >(x_begin, x_end, steps, slab_gen);
+	}
+
+	return 0;
+}
+
+template <typename Stencil>
+uint64_t Lattice::metropolis_sweep_slab_stencil(int x_begin, int x_end, unsigned steps, std::mt19937& slab_gen)
+{
+	if (boundary == BOUNDARY_HELICAL)
+	{
+		throw std::logic_error("Lattice::metropolis_sweep_slab(): Slabs of helical lattices are not supported");
+	}
+
+	if (disordered) return metropolis_sweep_slab_kernel<Stencil, DisorderedCouplings>(x_begin, x_end, steps, slab_gen);
+	else            return metropolis_sweep_slab_kernel<Stencil, UniformCouplings   >(x_begin, x_end, steps, slab_gen);
+}
+
+// Same random-site kernel as metropolis_sweep(), with sites drawn from the slab only:
+template <typename Stencil, typename Couplings>
+uint64_t Lattice::metropolis_sweep_slab_kernel(int x_begin, int x_end, unsigned steps, std::mt19937& slab_gen)
+{
+	// Slabs are swept concurrently, so the distributions of the lattice are not shared either:
+	std::uniform_int_distribution<uint32_t> slab_sites(0, (x_end - x_begin) * size_y * size_z * size_w - 1);
+	std::uniform_real_distribution<float> slab_floats(0.0, 1.0);
+
+	uint64_t flips = 0;
+	int coords[LATTICE_MAX_DIMS];
+	for (unsigned i = 0; i < steps; ++i)
+	{
+		uint32_t random_num = slab_sites(slab_gen);
+
+		coords[3] = random_num % size_w;
+		random_num /= size_w;
+		coords[2] = random_num % size_z;
 		random_num /= size_z;
-		int altered_y = (size_y + random_num) % size_y;
+		coords[1] = random_num % size_y;
 		random_num /= size_y;
-		int altered_x = (size_x + random_num) % size_x;
+		coords[0] = x_begin + random_num;
+
+		flips += metropolis_update<Stencil, Couplings>(coords, slab_gen, slab_floats);
+	}
+
+	return flips;
+}
+
+//============//
+// N-Fold Way //
+//============//
+
+// Row-major linear site to storage index:
+inline int Lattice::storage_index(int site) const
+{
+	if (boundary == BOUNDARY_HELICAL) return site;
 
-		char& cur_spin = get(altered_x, altered_y, altered_z);
+	int index = 0;
+	for (int axis = LATTICE_MAX_DIMS - 1; axis >= 0; --axis)
+	{
+		index += tables.offsets[axis][site % sizes[axis] + 1];
+		site /= sizes[axis];
+	}
 
-		char spin_l = get(altered_x-1, altered_y  , altered_z  );
-		char spin_r = get(altered_x+1, altered_y  , altered_z  );
-		char spin_u = get(altered_x  , altered_y-1, altered_z  );
-		char spin_d = get(altered_x  , altered_y+1, altered_z  );
-		char spin_t = get(altered_x  , altered_y  , altered_z-1);
-		char spin_b = get(altered_x  , altered_y  , altered_z+1);
-						
-		float interaction_vector = field +
-			interactivity * (spin_l + spin_r + spin_u + spin_d + spin_t + spin_b);
+	return index;
+}
 
-		float cur_energy = -interaction_vector * cur_spin;
+template <typename Stencil, typename Couplings>
+inline int Lattice::site_neighbour_sum(int site) const
+{
+	if (boundary == BOUNDARY_HELICAL)
+	{
+		return Couplings::template helical_sum<Stencil>(points, helical_deltas, site, couplings);
+	}
 
-		if (cur_energy > 0)
+	int coords[LATTICE_MAX_DIMS];
+	for (int axis = LATTICE_MAX_DIMS - 1; axis >= 0; --axis)
+	{
+		coords[axis] = site % sizes[axis];
+		site /= sizes[axis];
+	}
+
+	int index = tables.offsets[0][coords[0] + 1] + tables.offsets[1][coords[1] + 1] +
+	            tables.offsets[2][coords[2] + 1] + tables.offsets[3][coords[3] + 1];
+
+	return Couplings::template neighbour_sum<Stencil>(points, tables, coords, index, couplings);
+}
+
+// Linear sites of the neighbours, wrapped the same way the sweep wraps them:
+template <typename Stencil>
+inline void Lattice::site_neighbours(int site, int neighbours[Stencil::NEIGHBOURS]) const
+{
+	if (boundary == BOUNDARY_HELICAL)
+	{
+		for (int neighbour = 0; neighbour < Stencil::NEIGHBOURS; ++neighbour)
 		{
-			cur_spin = -cur_spin;
-			continue;
+			int linear = site + helical_deltas[neighbour];
+			if (linear <  0        ) linear += num_sites;
+			if (linear >= num_sites) linear -= num_sites;
+
+			neighbours[neighbour] = linear;
+		}
+
+		return;
+	}
+
+	int coords[LATTICE_MAX_DIMS];
+	for (int axis = LATTICE_MAX_DIMS - 1; axis >= 0; --axis)
+	{
+		coords[axis] = site % sizes[axis];
+		site /= sizes[axis];
+	}
+
+	for (int neighbour = 0; neighbour < Stencil::NEIGHBOURS; ++neighbour)
+	{
+		int linear = 0;
+		for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+		{
+			int coord = coords[axis] + Stencil::OFFSETS[neighbour][axis];
+			if (coord <  0           ) coord += sizes[axis];
+			if (coord >= sizes[axis]) coord -= sizes[axis];
+
+			linear = linear * sizes[axis] + coord;
+		}
+
+		neighbours[neighbour] = linear;
+	}
+}
+
+// Flat class index: ((field_class * 2) + spin_up) * (2 * STENCIL_MAX_NEIGHBOURS + 1) + sum.
+// Vacancies never flip, so they stay out of the buckets with the NFOLD_VACANCY class:
+template <typename Stencil, typename Couplings>
+void Lattice::nfold_rebuild()
+{
+	for (int field_class = 0; field_class < DISORDER_FIELD_CLASSES; ++field_class)
+	{
+		for (int spin_up = 0; spin_up < 2; ++spin_up)
+		{
+			for (int sum = 0; sum <= 2 * Stencil::NEIGHBOURS; ++sum) nfold_members[field_class][spin_up][sum].clear();
 		}
+	}
 
-		float acceptance_ratio = exp(2.0 * cur_energy / temperature);
-		float toss = floats(gen);
+	nfold_class   .resize(num_sites);
+	nfold_position.resize(num_sites);
 
-		if (toss < acceptance_ratio)
+	for (int site = 0; site < num_sites; ++site)
+	{
+		int index = storage_index(site);
+		if (points[index] == 0)
 		{
-			cur_spin = -cur_spin;
+			nfold_class[site] = NFOLD_VACANCY;
 			continue;
 		}
+
+		int field_class = Couplings::field_class(index, couplings);
+		int spin_up     = points[index] > 0;
+		int sum         = site_neighbour_sum<Stencil, Couplings>(site) + Stencil::NEIGHBOURS;
+
+		std::vector<int>& bucket = nfold_members[field_class][spin_up][sum];
+		nfold_class   [site] = (2 * field_class + spin_up) * (2 * STENCIL_MAX_NEIGHBOURS + 1) + sum;
+		nfold_position[site] = bucket.size();
+		bucket.push_back(site);
+	}
+
+	nfold_valid = true;
+}
+
+// Moves the site to the bucket of its current class (swap-with-last removal):
+template <typename Stencil, typename Couplings>
+inline void Lattice::nfold_update_class(int site)
+{
+	if (nfold_class[site] == NFOLD_VACANCY) return;
+
+	int index       = storage_index(site);
+	int field_class = Couplings::field_class(index, couplings);
+	int spin_up     = points[index] > 0;
+	int sum         = site_neighbour_sum<Stencil, Couplings>(site) + Stencil::NEIGHBOURS;
+	int cur_class = (2 * field_class + spin_up) * (2 * STENCIL_MAX_NEIGHBOURS + 1) + sum;
+
+	int old_class = nfold_class[site];
+	if (old_class == cur_class) return;
+
+	int old_group = old_class / (2 * STENCIL_MAX_NEIGHBOURS + 1);
+	std::vector<int>& old_bucket = nfold_members[old_group / 2][old_group % 2][old_class % (2 * STENCIL_MAX_NEIGHBOURS + 1)];
+	int moved = old_bucket.back();
+	old_bucket[nfold_position[site]] = moved;
+	nfold_position[moved] = nfold_position[site];
+	old_bucket.pop_back();
+
+	std::vector<int>& new_bucket = nfold_members[field_class][spin_up][sum];
+	nfold_class   [site] = cur_class;
+	nfold_position[site] = new_bucket.size();
+	new_bucket.push_back(site);
+}
+
+template <typename Stencil>
+uint64_t Lattice::nfold_sweep_stencil(unsigned steps)
+{
+	prepare_acceptance<Stencil>();
+
+	if (disordered) return nfold_sweep_kernel<Stencil, DisorderedCouplings>(steps);
+	else            return nfold_sweep_kernel<Stencil, UniformCouplings   >(steps);
+}
+
+// A Metropolis step flips a spin of class c with probability n_c * p_c / N, so flips
+// happen with probability q = Q / N, Q = sum_c n_c * p_c, and the number of steps to the
+// next flip is geometric: 1 + floor(ln u / ln(1 - q)). Waiting times are memoryless,
+// so an event that would overshoot the step budget is simply dropped.
+template <typename Stencil, typename Couplings>
+uint64_t Lattice::nfold_sweep_kernel(unsigned steps)
+{
+	if (!nfold_valid) nfold_rebuild<Stencil, Couplings>();
+
+	// Without random fields every site stays in the uniform field class:
+	int class_begin = random_fields? 0                      : FIELD_CLASS_UNIFORM;
+	int class_end   = random_fields? DISORDER_FIELD_CLASSES : FIELD_CLASS_UNIFORM + 1;
+
+	uint64_t flips = 0;
+	uint64_t done  = 0;
+	while (true)
+	{
+		double total_rate = 0.0;
+		for (int field_class = class_begin; field_class < class_end; ++field_class)
+		{
+			for (int spin_up = 0; spin_up < 2; ++spin_up)
+			{
+				for (int sum = 0; sum <= 2 * Stencil::NEIGHBOURS; ++sum)
+				{
+					total_rate += nfold_members[field_class][spin_up][sum].size() * acceptance[field_class][spin_up][sum];
+				}
+			}
+		}
+
+		if (total_rate <= 0.0) return flips;
+
+		double flip_probability = total_rate / num_sites;
+		uint64_t wait = 1;
+		if (flip_probability < 1.0)
+		{
+			double wait_extra = floor(log(1.0 - floats(gen)) / log1p(-flip_probability));
+			if (wait_extra >= steps) return flips;
+
+			wait += static_cast<uint64_t>(wait_extra);
+		}
+
+		if (done + wait > steps) return flips;
+		done += wait;
+
+		// Choose the class by its total rate, then a site of the class uniformly:
+		double target = floats(gen) * total_rate;
+		std::vector<int>* bucket = nullptr;
+		for (int field_class = class_begin; field_class < class_end && target >= 0.0; ++field_class)
+		{
+			for (int spin_up = 0; spin_up < 2 && target >= 0.0; ++spin_up)
+			{
+				for (int sum = 0; sum <= 2 * Stencil::NEIGHBOURS && target >= 0.0; ++sum)
+				{
+					const float rate = acceptance[field_class][spin_up][sum];
+					if (nfold_members[field_class][spin_up][sum].empty() || rate <= 0.0) continue;
+
+					bucket = &nfold_members[field_class][spin_up][sum];
+					target -= bucket->size() * rate;
+				}
+			}
+		}
+
+		int site = (*bucket)[std::uniform_int_distribution<int>(0, bucket->size() - 1)(gen)];
+
+		points[storage_index(site)] *= -1;
+		if (boundary == BOUNDARY_HELICAL) mirror_helical_ghost(site);
+		flips += 1;
+
+		int neighbours[Stencil::NEIGHBOURS];
+		site_neighbours<Stencil>(site, neighbours);
+
+		nfold_update_class<Stencil, Couplings>(site);
+		for (int neighbour = 0; neighbour < Stencil::NEIGHBOURS; ++neighbour)
+		{
+			nfold_update_class<Stencil, Couplings>(neighbours[neighbour]);
+		}
+	}
+}
+
+uint64_t Lattice::nfold_sweep(unsigned steps)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return nfold_sweep_stencil<SquareStencil           >(steps);
+		case GEOMETRY_TRIANGULAR:    return nfold_sweep_stencil<TriangularStencil       >(steps);
+		case GEOMETRY_SIMPLE_CUBIC:  return nfold_sweep_stencil<SimpleCubicStencil      >(steps);
+		case GEOMETRY_BCC:           return nfold_sweep_stencil<BodyCenteredCubicStencil>(steps);
+		case GEOMETRY_FCC:           return nfold_sweep_stencil<FaceCenteredCubicStencil>(steps);
+		case GEOMETRY_HYPERCUBIC_4D: return nfold_sweep_stencil<Hypercubic4DStencil     >(steps);
+	}
+
+	return 0;
+}
+
+uint64_t Lattice::metropolis_sweep(unsigned steps)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return metropolis_sweep_stencil<SquareStencil           >(steps);
+		case GEOMETRY_TRIANGULAR:    return metropolis_sweep_stencil<TriangularStencil       >(steps);
+		case GEOMETRY_SIMPLE_CUBIC:  return metropolis_sweep_stencil<SimpleCubicStencil      >(steps);
+		case GEOMETRY_BCC:           return metropolis_sweep_stencil<BodyCenteredCubicStencil>(steps);
+		case GEOMETRY_FCC:           return metropolis_sweep_stencil<FaceCenteredCubicStencil>(steps);
+		case GEOMETRY_HYPERCUBIC_4D: return metropolis_sweep_stencil<Hypercubic4DStencil     >(steps);
+	}
+
+	return 0;
+}
+
+uint64_t Lattice::metropolis_sweep_tiled(unsigned steps)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return metropolis_sweep_tiled_stencil<SquareStencil           >(steps);
+		case GEOMETRY_TRIANGULAR:    return metropolis_sweep_tiled_stencil<TriangularStencil       >(steps);
+		case GEOMETRY_SIMPLE_CUBIC:  return metropolis_sweep_tiled_stencil<SimpleCubicStencil      >(steps);
+		case GEOMETRY_BCC:           return metropolis_sweep_tiled_stencil<BodyCenteredCubicStencil>(steps);
+		case GEOMETRY_FCC:           return metropolis_sweep_tiled_stencil<FaceCenteredCubicStencil>(steps);
+		case GEOMETRY_HYPERCUBIC_4D: return metropolis_sweep_tiled_stencil<Hypercubic4DStencil     >(steps);
+	}
+
+	return 0;
+}
+
+//=============//
+// Wang-Landau //
+//=============//
+
+void Lattice::wang_landau_sweep(WangLandauWalker& walker, unsigned steps)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        wang_landau_sweep_stencil<SquareStencil           >(walker, steps); break;
+		case GEOMETRY_TRIANGULAR:    wang_landau_sweep_stencil<TriangularStencil       >(walker, steps); break;
+		case GEOMETRY_SIMPLE_CUBIC:  wang_landau_sweep_stencil<SimpleCubicStencil      >(walker, steps); break;
+		case GEOMETRY_BCC:           wang_landau_sweep_stencil<BodyCenteredCubicStencil>(walker, steps); break;
+		case GEOMETRY_FCC:           wang_landau_sweep_stencil<FaceCenteredCubicStencil>(walker, steps); break;
+		case GEOMETRY_HYPERCUBIC_4D: wang_landau_sweep_stencil<Hypercubic4DStencil     >(walker, steps); break;
+	}
+}
+
+// The sum of h_i s_i is a third energy axis the walker does not track:
+template <typename Stencil>
+void Lattice::wang_landau_sweep_stencil(WangLandauWalker& walker, unsigned steps)
+{
+	if (random_fields)
+	{
+		throw std::logic_error("Lattice::wang_landau_sweep(): Random fields are not supported");
+	}
+
+	nfold_valid = false;
+
+	if (disordered) wang_landau_sweep_kernel<Stencil, DisorderedCouplings>(walker, steps);
+	else            wang_landau_sweep_kernel<Stencil, UniformCouplings   >(walker, steps);
+}
+
+// Flipping s_i changes the bond sum by -2 s_i sum_j J_ij s_j and the total spin by -2 s_i
+// (vacancies change neither). Rejected moves count as a visit of the current bin:
+template <typename Stencil, typename Couplings>
+void Lattice::wang_landau_sweep_kernel(WangLandauWalker& walker, unsigned steps)
+{
+	int coords[LATTICE_MAX_DIMS];
+	for (unsigned i = 0; i < steps; ++i)
+	{
+		int site;
+		int neighbour_sum;
+		if (boundary == BOUNDARY_HELICAL)
+		{
+			site = sites(gen);
+			neighbour_sum = Couplings::template helical_sum<Stencil>(points, helical_deltas, site, couplings);
+		}
+		else
+		{
+			random_site(coords);
+			site = tables.offsets[0][coords[0] + 1] + tables.offsets[1][coords[1] + 1] +
+			       tables.offsets[2][coords[2] + 1] + tables.offsets[3][coords[3] + 1];
+			neighbour_sum = Couplings::template neighbour_sum<Stencil>(points, tables, coords, site, couplings);
+		}
+
+		int cur_spin = points[site];
+		int bond_delta = -2 * cur_spin * neighbour_sum;
+		int spin_delta = -2 * cur_spin;
+
+		double log_ratio = walker.log_ratio(bond_delta, spin_delta);
+		if (log_ratio >= 0.0 || log(floats(gen)) < log_ratio)
+		{
+			points[site] = -cur_spin;
+			if (boundary == BOUNDARY_HELICAL) mirror_helical_ghost(site);
+
+			walker.move(bond_delta, spin_delta);
+		}
+
+		walker.visit();
+	}
+}
+
+//===================//
+// Quenched Disorder //
+//===================//
+
+void Lattice::generate_disorder(const DisorderParams& params, uint32_t seed)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        generate_disorder_stencil<SquareStencil           >(params, seed); break;
+		case GEOMETRY_TRIANGULAR:    generate_disorder_stencil<TriangularStencil       >(params, seed); break;
+		case GEOMETRY_SIMPLE_CUBIC:  generate_disorder_stencil<SimpleCubicStencil      >(params, seed); break;
+		case GEOMETRY_BCC:           generate_disorder_stencil<BodyCenteredCubicStencil>(params, seed); break;
+		case GEOMETRY_FCC:           generate_disorder_stencil<FaceCenteredCubicStencil>(params, seed); break;
+		case GEOMETRY_HYPERCUBIC_4D: generate_disorder_stencil<Hypercubic4DStencil     >(params, seed); break;
+	}
+}
+
+// Every bond is drawn once, from the end whose direction precedes the opposite one,
+// and written into the planes of both ends:
+template <typename Stencil>
+void Lattice::generate_disorder_stencil(const DisorderParams& params, uint32_t seed)
+{
+	clear_disorder();
+	if (!disorder_enabled(params)) return;
+
+	int opposites[Stencil::NEIGHBOURS];
+	for (int neighbour = 0; neighbour < Stencil::NEIGHBOURS; ++neighbour)
+	{
+		opposites[neighbour] = stencil_opposite<Stencil>(neighbour);
+		if (opposites[neighbour] < 0)
+		{
+			throw std::logic_error("Lattice::generate_disorder(): Stencil is not symmetric");
+		}
+	}
+
+	size_t plane_size = tables.storage_size;
+	bond_storage .assign(Stencil::NEIGHBOURS * plane_size, 0);
+	field_storage.assign(plane_size, 0);
+
+	for (int neighbour = 0; neighbour < Stencil::NEIGHBOURS; ++neighbour)
+	{
+		couplings.bonds[neighbour] = bond_storage.data() + neighbour * plane_size;
+	}
+	couplings.fields = field_storage.data();
+
+	std::mt19937 disorder_gen(seed);
+	std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+	for (int site = 0; site < num_sites; ++site)
+	{
+		int index = storage_index(site);
+
+		int neighbours[Stencil::NEIGHBOURS];
+		site_neighbours<Stencil>(site, neighbours);
+
+		for (int neighbour = 0; neighbour < Stencil::NEIGHBOURS; ++neighbour)
+		{
+			if (opposites[neighbour] < neighbour) continue;
+
+			int8_t coupling = 1;
+			if      (uniform(disorder_gen) < params.bond_dilution)      coupling =  0;
+			else if (uniform(disorder_gen) < params.antiferro_fraction) coupling = -1;
+
+			bond_storage[neighbour * plane_size + index] = coupling;
+			bond_storage[opposites[neighbour] * plane_size + storage_index(neighbours[neighbour])] = coupling;
+		}
+
+		if (params.random_field) field_storage[index] = uniform(disorder_gen) < 0.5? -1 : +1;
+
+		if (uniform(disorder_gen) < params.site_dilution) vacancies.push_back(index);
 	}
+
+	disordered    = true;
+	random_fields = params.random_field;
+
+	for (int index : vacancies) points[index] = 0;
+	spins_changed();
+}
+
+// Vacant sites get a spin back:
+void Lattice::clear_disorder()
+{
+	for (int index : vacancies) points[index] = 1;
+
+	disordered    = false;
+	random_fields = false;
+	bond_storage .clear();
+	field_storage.clear();
+	vacancies    .clear();
+	couplings = CouplingArrays();
+
+	spins_changed();
+}
+
+bool Lattice::is_disordered() const
+{
+	return disordered;
 }
 
 float Lattice::calculate_average_spin() const
@@ -147,12 +1289,94 @@ float Lattice::calculate_average_spin() const
 	for (int x = 0; x < size_x; ++x) {
 	for (int y = 0; y < size_y; ++y) {
 	for (int z = 0; z < size_z; ++z) {
-		spin += get(x, y, z);
-	}}}
-	
-	spin /= size_x*size_y*size_z;
+	for (int w = 0; w < size_w; ++w) {
+		spin += get(x, y, z, w);
+	}}}}
+
+	spin /= num_sites;
+
+	return spin;
+}
+
+template <typename Stencil>
+int Lattice::calculate_bond_sum_stencil() const
+{
+	if (disordered) return calculate_bond_sum_kernel<Stencil, DisorderedCouplings>();
+	else            return calculate_bond_sum_kernel<Stencil, UniformCouplings   >();
+}
+
+template <typename Stencil, typename Couplings>
+int Lattice::calculate_bond_sum_kernel() const
+{
+	// Every bond is seen from both of its ends:
+	long doubled_sum = 0;
+
+	if (boundary == BOUNDARY_HELICAL)
+	{
+		for (int site = 0; site < num_sites; ++site)
+		{
+			doubled_sum += points[site] * Couplings::template helical_sum<Stencil>(points, helical_deltas, site, couplings);
+		}
+
+		return doubled_sum / 2;
+	}
+
+	int coords[LATTICE_MAX_DIMS];
+	for (coords[0] = 0; coords[0] < size_x; ++coords[0]) {
+	for (coords[1] = 0; coords[1] < size_y; ++coords[1]) {
+	for (coords[2] = 0; coords[2] < size_z; ++coords[2]) {
+	for (coords[3] = 0; coords[3] < size_w; ++coords[3]) {
+		int site = tables.offsets[0][coords[0] + 1] + tables.offsets[1][coords[1] + 1] +
+		           tables.offsets[2][coords[2] + 1] + tables.offsets[3][coords[3] + 1];
+		doubled_sum += points[site] * Couplings::template neighbour_sum<Stencil>(points, tables, coords, site, couplings);
+	}}}}
+
+	return doubled_sum / 2;
+}
+
+int Lattice::calculate_bond_sum() const
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return calculate_bond_sum_stencil<SquareStencil           >();
+		case GEOMETRY_TRIANGULAR:    return calculate_bond_sum_stencil<TriangularStencil       >();
+		case GEOMETRY_SIMPLE_CUBIC:  return calculate_bond_sum_stencil<SimpleCubicStencil      >();
+		case GEOMETRY_BCC:           return calculate_bond_sum_stencil<BodyCenteredCubicStencil>();
+		case GEOMETRY_FCC:           return calculate_bond_sum_stencil<FaceCenteredCubicStencil>();
+		case GEOMETRY_HYPERCUBIC_4D: return calculate_bond_sum_stencil<Hypercubic4DStencil     >();
+	}
+
+	return 0;
+}
+
+int Lattice::calculate_total_spin() const
+{
+	int spin = 0;
+
+	for (int x = 0; x < size_x; ++x) {
+	for (int y = 0; y < size_y; ++y) {
+	for (int z = 0; z < size_z; ++z) {
+	for (int w = 0; w < size_w; ++w) {
+		spin += get(x, y, z, w);
+	}}}}
 
 	return spin;
 }
 
+void Lattice::pack_spins(uint8_t* packed) const
+{
+	std::fill(packed, packed + (num_sites + 7) / 8, 0);
+
+	int site = 0;
+	for (int x = 0; x < size_x; ++x) {
+	for (int y = 0; y < size_y; ++y) {
+	for (int z = 0; z < size_z; ++z) {
+		int base = tables.offsets[0][x + 1] + tables.offsets[1][y + 1] + tables.offsets[2][z + 1];
+		for (int w = 0; w < size_w; ++w, ++site)
+		{
+			if (points[base + tables.offsets[3][w + 1]] > 0) packed[site / 8] |= 1 << (site % 8);
+		}
+	}}}
+}
+
 #endif // ISING_MODEL_STATE_GRAPH_HPP_INCLUDED
@@ -0,0 +1,292 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_PLANNER_HPP_INCLUDED
+#define ISING_MODEL_PLANNER_HPP_INCLUDED
+
+#include "ThreadCoreScalability.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//================//
+// Cache Topology //
+//================//
+
+struct CacheTopology
+{
+	size_t l1d_bytes;
+	size_t l2_bytes;
+	size_t l3_bytes;      // One L3 instance
+	int l3_instances;
+	int online_harts;
+	int physical_cores;
+};
+
+// Reads sysfs values like "48K" or "32M"; returns 0 on failure:
+size_t read_sysfs_size(const char* filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) return 0;
+
+	char buf[64];
+	int buf_len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+
+	if (buf_len <= 0) return 0;
+	buf[buf_len] = '\0';
+
+	char* end_ptr = buf;
+	size_t value = strtoul(buf, &end_ptr, 10);
+	if (end_ptr == buf) return 0;
+
+	if (*end_ptr == 'K') value <<= 10;
+	if (*end_ptr == 'M') value <<= 20;
+	if (*end_ptr == 'G') value <<= 30;
+
+	return value;
+}
+
+// Number of harts in a sysfs list like "0-3,8-11"; returns 0 on failure:
+int count_sysfs_cpu_list(const char* filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) return 0;
+
+	char buf[256];
+	int buf_len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+
+	if (buf_len <= 0) return 0;
+	buf[buf_len] = '\0';
+
+	int count = 0;
+	char* cur_char = buf;
+	while (*cur_char != '\0' && *cur_char != '\n')
+	{
+		char* end_ptr = cur_char;
+		long first = strtol(cur_char, &end_ptr, 10);
+		if (end_ptr == cur_char) return 0;
+		cur_char = end_ptr;
+
+		long last = first;
+		if (*cur_char == '-')
+		{
+			cur_char += 1;
+			last = strtol(cur_char, &end_ptr, 10);
+			if (end_ptr == cur_char || last < first) return 0;
+			cur_char = end_ptr;
+		}
+
+		count += last - first + 1;
+
+		if (*cur_char == ',') cur_char += 1;
+	}
+
+	return count;
+}
+
+// Caches of cpu0 stand for every core. Missing sysfs entries fall back to modest defaults:
+CacheTopology read_cache_topology()
+{
+	CacheTopology topology;
+	topology.l1d_bytes      = 32 << 10;
+	topology.l2_bytes       = 256 << 10;
+	topology.l3_bytes       = 8 << 20;
+	topology.l3_instances   = 1;
+	topology.online_harts   = std::max(count_sysfs_cpu_list("/sys/devices/system/cpu/online"), 1);
+	topology.physical_cores = topology.online_harts;
+
+	int l3_sharing = 0;
+	for (int index = 0; index < 8; ++index)
+	{
+		char filename[128];
+
+		snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+		long level = read_sysfs_long(filename);
+		if (level == -1) break;
+
+		// Instruction caches do not hold the lattice:
+		snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+		int type_fd = open(filename, O_RDONLY);
+		if (type_fd == -1) continue;
+
+		char type[32] = {};
+		int type_len = read(type_fd, type, sizeof(type) - 1);
+		close(type_fd);
+		if (type_len <= 0 || strncmp(type, "Instruction", 11) == 0) continue;
+
+		snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+		size_t size = read_sysfs_size(filename);
+		if (size == 0) continue;
+
+		if (level == 1) topology.l1d_bytes = size;
+		if (level == 2) topology.l2_bytes  = size;
+		if (level == 3)
+		{
+			topology.l3_bytes = size;
+
+			snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu0/cache/index%d/shared_cpu_list", index);
+			l3_sharing = count_sysfs_cpu_list(filename);
+		}
+	}
+
+	if (l3_sharing > 0) topology.l3_instances = std::max(topology.online_harts / l3_sharing, 1);
+
+	// SMT siblings share the core and its private caches:
+	int siblings = count_sysfs_cpu_list("/sys/devices/system/cpu/cpu0/topology/thread_siblings_list");
+	if (siblings > 0) topology.physical_cores = std::max(topology.online_harts / siblings, 1);
+
+	return topology;
+}
+
+//======================//
+// Parallelism Planning //
+//======================//
+
+// A team splits one lattice into 2 * team_size slabs along x: even slabs are swept
+// in one phase, odd slabs in the next, with a barrier in between. Slabs never touch
+// their neighbours in the same phase, so team members need no locking at all.
+enum ParallelismMode
+{
+	PARALLELISM_AUTO        = 0,
+	PARALLELISM_INDEPENDENT = 1,
+	PARALLELISM_TEAMS       = 2
+};
+
+const char* parallelism_mode_name(ParallelismMode mode)
+{
+	switch (mode)
+	{
+		case PARALLELISM_AUTO:        return "auto";
+		case PARALLELISM_INDEPENDENT: return "independent";
+		case PARALLELISM_TEAMS:       return "teams";
+	}
+
+	return "unknown";
+}
+
+bool parse_parallelism_mode(const char* name, ParallelismMode* mode)
+{
+	if (name == nullptr || mode == nullptr) return false;
+
+	if (strcmp(name, "auto"       ) == 0) { *mode = PARALLELISM_AUTO;        return true; }
+	if (strcmp(name, "independent") == 0) { *mode = PARALLELISM_INDEPENDENT; return true; }
+	if (strcmp(name, "teams"      ) == 0) { *mode = PARALLELISM_TEAMS;       return true; }
+
+	return false;
+}
+
+// Every slab phase ends in a barrier (a few microseconds); phases shorter than this
+// many Metropolis steps would spend a noticeable share of the time synchronizing:
+const unsigned TEAM_MIN_SLAB_SITES = 1 << 14;
+
+enum ParallelStrategy
+{
+	STRATEGY_INDEPENDENT = 0, // One lattice per thread
+	STRATEGY_HYBRID      = 1, // One lattice per thread, teams while the queue drains
+	STRATEGY_TEAMS       = 2  // Teams from the start
+};
+
+const char* parallel_strategy_name(ParallelStrategy strategy)
+{
+	switch (strategy)
+	{
+		case STRATEGY_INDEPENDENT: return "independent";
+		case STRATEGY_HYBRID:      return "hybrid";
+		case STRATEGY_TEAMS:       return "teams";
+	}
+
+	return "unknown";
+}
+
+struct PlannerInput
+{
+	ParallelismMode mode;
+	bool teams_supported;  // Slab sweeps exist for periodic Metropolis runs only
+	int size_x;
+	int num_sites;
+	size_t lattice_bytes;  // Spins plus coupling planes of one lattice
+	unsigned num_tasks;
+	int num_threads;
+};
+
+struct ParallelPlan
+{
+	ParallelStrategy strategy;
+	int max_team;   // Largest team a lattice may get
+	int base_team;  // Team size while the queue holds more tasks than free threads
+	size_t lattice_bytes;
+	CacheTopology topology;
+};
+
+ParallelPlan plan_parallelism(const PlannerInput& input, const CacheTopology& topology)
+{
+	ParallelPlan plan;
+	plan.lattice_bytes = input.lattice_bytes;
+	plan.topology      = topology;
+
+	// Every slab must be at least one site thick (the stencil reach):
+	plan.max_team = std::min(input.num_threads, input.size_x / 2);
+
+	if (input.mode == PARALLELISM_AUTO)
+	{
+		// SMT siblings would only split the core they share:
+		plan.max_team = std::min(plan.max_team, topology.physical_cores);
+		plan.max_team = std::min(plan.max_team, static_cast<int>(input.num_sites / (2 * TEAM_MIN_SLAB_SITES)));
+	}
+
+	if (input.mode == PARALLELISM_INDEPENDENT || !input.teams_supported) plan.max_team = 1;
+	plan.max_team = std::max(plan.max_team, 1);
+
+	// Smallest team that keeps the lattices of all running teams in the last level cache.
+	// Past max_team, lattices stay memory-bound and the largest team at least shares the misses:
+	size_t llc_bytes = topology.l3_bytes * topology.l3_instances;
+	plan.base_team = plan.max_team;
+	for (int team = 1; team <= plan.max_team; ++team)
+	{
+		size_t running_teams = (input.num_threads + team - 1) / team;
+		if (running_teams * input.lattice_bytes <= llc_bytes)
+		{
+			plan.base_team = team;
+			break;
+		}
+	}
+
+	if (input.mode == PARALLELISM_TEAMS) plan.base_team = plan.max_team;
+
+	if      (plan.max_team  == 1)             plan.strategy = STRATEGY_INDEPENDENT;
+	else if (plan.base_team == plan.max_team) plan.strategy = STRATEGY_TEAMS;
+	else                                      plan.strategy = STRATEGY_HYBRID;
+
+	// A queue that can never fill the machine gets teams from the first task:
+	if (plan.strategy == STRATEGY_HYBRID && input.num_tasks * plan.base_team < static_cast<unsigned>(input.num_threads))
+	{
+		plan.strategy = STRATEGY_TEAMS;
+	}
+
+	return plan;
+}
+
+// Size of the team for the next task, given the threads not tied up in other teams
+// and the tasks left in the queue (this one included): free threads are spread
+// over the remaining tasks, so the last few tasks do not end up on single cores.
+int plan_team_size(const ParallelPlan& plan, int available_threads, unsigned remaining_tasks)
+{
+	if (remaining_tasks == 0 || available_threads <= 0) return 1;
+
+	int team = std::max(plan.base_team, static_cast<int>(available_threads / remaining_tasks));
+
+	return std::max(std::min(team, std::min(plan.max_team, available_threads)), 1);
+}
+
+void print_parallel_plan(FILE* output, const char* prefix, const ParallelPlan& plan)
+{
+	fprintf(output, "%s Parallel plan: %s, teams of %d..%d threads "
+	        "(lattice %zu KiB, L2 %zu KiB, L3 %zu KiB x %d, %d cores / %d harts)\n",
+	        prefix, parallel_strategy_name(plan.strategy), plan.base_team, plan.max_team,
+	        plan.lattice_bytes >> 10, plan.topology.l2_bytes >> 10, plan.topology.l3_bytes >> 10,
+	        plan.topology.l3_instances, plan.topology.physical_cores, plan.topology.online_harts);
+}
+
+#endif // ISING_MODEL_PLANNER_HPP_INCLUDED
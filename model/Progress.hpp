@@ -0,0 +1,271 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_PROGRESS_HPP_INCLUDED
+#define ISING_MODEL_PROGRESS_HPP_INCLUDED
+
+#include "ThreadCoreScalability.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <pthread.h>
+#include <time.h>
+
+//===================//
+// Progress Counters //
+//===================//
+
+// Sweeps are split into chunks of this many steps so that counters stay fresh:
+const unsigned PROGRESS_CHUNK_STEPS = 1 << 18;
+
+// Every counter is written by its owning thread only (relaxed load + store, no RMW)
+// and read by the reporter. Counters of different threads never share a cache line.
+// Steps are attempted spin updates, flips are the accepted ones:
+struct ThreadProgress
+{
+	std::atomic<uint64_t> tasks_done;
+	std::atomic<uint64_t> steps_done;
+	std::atomic<uint64_t> flips_done;
+	std::atomic<float> temperature;
+	std::atomic<float> field;
+
+	char padding[CACHE_LINE_SIZE - 3 * sizeof(std::atomic<uint64_t>) - 2 * sizeof(std::atomic<float>)];
+};
+
+static_assert(sizeof(ThreadProgress) == CACHE_LINE_SIZE, "ThreadProgress must fill exactly one cache line");
+
+ThreadProgress* allocate_thread_progress(int num_threads)
+{
+	void* memory = nullptr;
+	if (posix_memalign(&memory, CACHE_LINE_SIZE, num_threads * sizeof(ThreadProgress)) != 0)
+	{
+		fprintf(stderr, "[PROGRESS] Unable to allocate progress counters!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ThreadProgress* progress = reinterpret_cast<ThreadProgress*>(memory);
+	for (int thr = 0; thr < num_threads; ++thr)
+	{
+		new (&progress[thr]) ThreadProgress;
+		progress[thr].tasks_done .store(0,   std::memory_order_relaxed);
+		progress[thr].steps_done .store(0,   std::memory_order_relaxed);
+		progress[thr].flips_done .store(0,   std::memory_order_relaxed);
+		progress[thr].temperature.store(0.0, std::memory_order_relaxed);
+		progress[thr].field      .store(0.0, std::memory_order_relaxed);
+	}
+
+	return progress;
+}
+
+void free_thread_progress(ThreadProgress* progress, int num_threads)
+{
+	if (progress == nullptr) return;
+
+	for (int thr = 0; thr < num_threads; ++thr) progress[thr].~ThreadProgress();
+	free(progress);
+}
+
+inline void progress_add_steps(ThreadProgress* progress, uint64_t steps, uint64_t flips)
+{
+	if (progress == nullptr) return;
+
+	progress->steps_done.store(progress->steps_done.load(std::memory_order_relaxed) + steps, std::memory_order_relaxed);
+	progress->flips_done.store(progress->flips_done.load(std::memory_order_relaxed) + flips, std::memory_order_relaxed);
+}
+
+inline void progress_start_task(ThreadProgress* progress, float temperature, float field)
+{
+	if (progress == nullptr) return;
+
+	progress->temperature.store(temperature, std::memory_order_relaxed);
+	progress->field      .store(field,       std::memory_order_relaxed);
+}
+
+inline void progress_finish_task(ThreadProgress* progress)
+{
+	if (progress == nullptr) return;
+
+	progress->tasks_done.store(progress->tasks_done.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+//=================//
+// Status Reporter //
+//=================//
+
+double progress_seconds_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+class ProgressReporter
+{
+private:
+	const ThreadProgress* progress;
+	int num_threads;
+
+	uint64_t total_tasks;
+	uint64_t total_steps;
+
+	std::string status_filename;
+	unsigned interval_ms;
+
+	double start_time;
+	double last_report_time;
+	uint64_t* last_flips;
+
+	pthread_mutex_t stop_mutex;
+	pthread_cond_t  stop_cond;
+	bool stopping;
+	pthread_t reporter_thread;
+
+	static void* reporter_main(void* arg);
+
+public:
+	ProgressReporter(const ThreadProgress* progress, int num_threads, uint64_t total_tasks, uint64_t total_steps,
+	                 const char* status_filename, unsigned interval_ms);
+
+	// Stops the reporter thread and writes the final status:
+	~ProgressReporter();
+
+	void write_status();
+};
+
+ProgressReporter::ProgressReporter(const ThreadProgress* prog, int num_thr, uint64_t tasks, uint64_t steps,
+                                   const char* filename, unsigned interval) :
+	progress         (prog),
+	num_threads      (num_thr),
+	total_tasks      (tasks),
+	total_steps      (steps),
+	status_filename  (filename),
+	interval_ms      (interval == 0? 1000 : interval),
+	start_time       (progress_seconds_now()),
+	last_report_time (start_time),
+	last_flips       (new uint64_t[num_thr]()),
+	stopping         (false)
+{
+	pthread_mutex_init(&stop_mutex, nullptr);
+	pthread_cond_init (&stop_cond,  nullptr);
+
+	if (pthread_create(&reporter_thread, nullptr, reporter_main, this) != 0)
+	{
+		delete[] last_flips;
+		throw std::runtime_error("ProgressReporter::ProgressReporter(): Unable to create reporter thread");
+	}
+}
+
+ProgressReporter::~ProgressReporter()
+{
+	pthread_mutex_lock(&stop_mutex);
+	stopping = true;
+	pthread_cond_signal(&stop_cond);
+	pthread_mutex_unlock(&stop_mutex);
+
+	pthread_join(reporter_thread, nullptr);
+
+	write_status();
+
+	pthread_mutex_destroy(&stop_mutex);
+	pthread_cond_destroy (&stop_cond);
+
+	delete[] last_flips;
+}
+
+void* ProgressReporter::reporter_main(void* arg)
+{
+	ProgressReporter* reporter = reinterpret_cast<ProgressReporter*>(arg);
+
+	pthread_mutex_lock(&reporter->stop_mutex);
+	while (!reporter->stopping)
+	{
+		struct timespec wake_up;
+		clock_gettime(CLOCK_REALTIME, &wake_up);
+		wake_up.tv_sec  += reporter->interval_ms / 1000;
+		wake_up.tv_nsec += (reporter->interval_ms % 1000) * 1000000L;
+		if (wake_up.tv_nsec >= 1000000000L)
+		{
+			wake_up.tv_sec  += 1;
+			wake_up.tv_nsec -= 1000000000L;
+		}
+
+		pthread_cond_timedwait(&reporter->stop_cond, &reporter->stop_mutex, &wake_up);
+		if (reporter->stopping) break;
+
+		pthread_mutex_unlock(&reporter->stop_mutex);
+		reporter->write_status();
+		pthread_mutex_lock(&reporter->stop_mutex);
+	}
+	pthread_mutex_unlock(&reporter->stop_mutex);
+
+	return nullptr;
+}
+
+// The status file is replaced atomically, so readers never see a partial report:
+void ProgressReporter::write_status()
+{
+	double now = progress_seconds_now();
+	double elapsed = now - start_time;
+	double since_last = now - last_report_time;
+	last_report_time = now;
+
+	std::string temp_filename = status_filename + ".tmp";
+	FILE* status_file = fopen(temp_filename.c_str(), "w");
+	if (status_file == nullptr)
+	{
+		fprintf(stderr, "[PROGRESS] Unable to open status file!\n");
+		return;
+	}
+
+	uint64_t tasks_done = 0;
+	uint64_t steps_done = 0;
+	double flips_per_sec_now = 0.0;
+	for (int thr = 0; thr < num_threads; ++thr)
+	{
+		tasks_done += progress[thr].tasks_done.load(std::memory_order_relaxed);
+		steps_done += progress[thr].steps_done.load(std::memory_order_relaxed);
+	}
+
+	fprintf(status_file, "thread\ttasks_done\tsteps_done\tflips_done\tflips_per_sec\tT\tH\n");
+	for (int thr = 0; thr < num_threads; ++thr)
+	{
+		uint64_t thread_flips = progress[thr].flips_done.load(std::memory_order_relaxed);
+		double thread_rate = since_last > 0.0? (thread_flips - last_flips[thr]) / since_last : 0.0;
+		last_flips[thr] = thread_flips;
+		flips_per_sec_now += thread_rate;
+
+		fprintf(status_file, "%d\t%llu\t%llu\t%llu\t%.4e\t%.3f\t%.3f\n", thr,
+		        static_cast<unsigned long long>(progress[thr].tasks_done.load(std::memory_order_relaxed)),
+		        static_cast<unsigned long long>(progress[thr].steps_done.load(std::memory_order_relaxed)),
+		        static_cast<unsigned long long>(thread_flips), thread_rate,
+		        progress[thr].temperature.load(std::memory_order_relaxed),
+		        progress[thr].field      .load(std::memory_order_relaxed));
+	}
+
+	double fraction = total_steps == 0? 1.0 : 1.0 * steps_done / total_steps;
+	double average_rate = elapsed > 0.0? steps_done / elapsed : 0.0;
+	double eta = average_rate > 0.0? (total_steps - steps_done) / average_rate : -1.0;
+
+	fprintf(status_file, "\n");
+	fprintf(status_file, "elapsed_sec\t%.1f\n", elapsed);
+	fprintf(status_file, "tasks_done\t%llu/%llu\n",
+	        static_cast<unsigned long long>(tasks_done), static_cast<unsigned long long>(total_tasks));
+	fprintf(status_file, "progress\t%.4f\n", fraction);
+	fprintf(status_file, "steps_per_sec\t%.4e\n", average_rate);
+	fprintf(status_file, "flips_per_sec\t%.4e\n", flips_per_sec_now);
+	fprintf(status_file, "eta_sec\t%.1f\n", eta);
+
+	fclose(status_file);
+
+	if (rename(temp_filename.c_str(), status_filename.c_str()) != 0)
+	{
+		fprintf(stderr, "[PROGRESS] Unable to replace status file!\n");
+	}
+}
+
+#endif // ISING_MODEL_PROGRESS_HPP_INCLUDED
@@ -0,0 +1,326 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_REWEIGHTING_HPP_INCLUDED
+#define ISING_MODEL_REWEIGHTING_HPP_INCLUDED
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+//=====================//
+// Physical Parameters //
+//=====================//
+
+// Energy of a configuration with bond sum B = sum_<ij> s_i s_j and total spin M:
+//     E(B, M) = -interactivity * B - magnetic_moment * H * M
+struct ReweightingParams
+{
+	double interactivity;   // Joules
+	double magnetic_moment; // Joules per unit of field
+	double boltzmann;       // Joules per Kelvin
+	unsigned num_sites;
+};
+
+double configuration_energy(const ReweightingParams& params, int bond_sum, int spin_sum, double field)
+{
+	return -params.interactivity * bond_sum - params.magnetic_moment * field * spin_sum;
+}
+
+//=================//
+// Histogram Store //
+//=================//
+
+class EnergyHistogram
+{
+public:
+	// Simulated point:
+	float temperature;
+	float field;
+
+	unsigned long num_measurements;
+	std::unordered_map<int64_t, unsigned long> counts;
+
+	EnergyHistogram();
+
+	void record(int bond_sum, int spin_sum);
+	void merge(const EnergyHistogram& other);
+
+	static int64_t pack    (int bond_sum, int spin_sum);
+	static int     bond_sum(int64_t key);
+	static int     spin_sum(int64_t key);
+};
+
+EnergyHistogram::EnergyHistogram() :
+	temperature      (0.0),
+	field            (0.0),
+	num_measurements (0),
+	counts           ()
+{}
+
+inline int64_t EnergyHistogram::pack(int bond_sum, int spin_sum)
+{
+	// Shifted as unsigned, a negative bond sum must not be left-shifted:
+	return static_cast<int64_t>((static_cast<uint64_t>(static_cast<uint32_t>(bond_sum)) << 32) |
+	                            static_cast<uint32_t>(spin_sum));
+}
+
+inline int EnergyHistogram::bond_sum(int64_t key)
+{
+	return static_cast<int>(key >> 32);
+}
+
+inline int EnergyHistogram::spin_sum(int64_t key)
+{
+	return static_cast<int32_t>(static_cast<uint32_t>(key));
+}
+
+void EnergyHistogram::record(int bond_sum, int spin_sum)
+{
+	counts[pack(bond_sum, spin_sum)] += 1;
+	num_measurements += 1;
+}
+
+void EnergyHistogram::merge(const EnergyHistogram& other)
+{
+	for (const auto& bin : other.counts)
+	{
+		counts[bin.first] += bin.second;
+	}
+
+	num_measurements += other.num_measurements;
+}
+
+//===================//
+// Density of States //
+//===================//
+
+// Estimated log density of states ln g(B, M), up to an additive constant.
+// Observables at any (T, H) follow from P(B, M) ~ g(B, M) * exp(-E(B, M) / kT).
+struct DensityOfStates
+{
+	std::vector<int> bond_sums;
+	std::vector<int> spin_sums;
+	std::vector<double> log_g;
+
+	// Bond sums beyond these were cut off from a truncated walk (INT32_MIN/INT32_MAX if nothing was cut):
+	int cut_min;
+	int cut_max;
+
+	DensityOfStates();
+};
+
+DensityOfStates::DensityOfStates() :
+	bond_sums (),
+	spin_sums (),
+	log_g     (),
+	cut_min   (INT32_MIN),
+	cut_max   (INT32_MAX)
+{}
+
+// Single-histogram estimate: ln g = ln N(B, M) + E(B, M) / kT_0
+DensityOfStates density_from_histogram(const EnergyHistogram& histogram, const ReweightingParams& params)
+{
+	double beta = 1.0 / (params.boltzmann * histogram.temperature);
+
+	DensityOfStates dos;
+	for (const auto& bin : histogram.counts)
+	{
+		int bond_sum = EnergyHistogram::bond_sum(bin.first);
+		int spin_sum = EnergyHistogram::spin_sum(bin.first);
+
+		dos.bond_sums.push_back(bond_sum);
+		dos.spin_sums.push_back(spin_sum);
+		dos.log_g.push_back(log(static_cast<double>(bin.second)) +
+		                    beta * configuration_energy(params, bond_sum, spin_sum, histogram.field));
+	}
+
+	return dos;
+}
+
+double log_sum_exp(const std::vector<double>& terms)
+{
+	double max_term = -INFINITY;
+	for (double term : terms) if (term > max_term) max_term = term;
+	if (max_term == -INFINITY) return -INFINITY;
+
+	double sum = 0.0;
+	for (double term : terms) sum += exp(term - max_term);
+
+	return max_term + log(sum);
+}
+
+// Ferrenberg-Swendsen multiple-histogram estimate. The free energies f_k = -ln Z_k
+// solve the self-consistency equations
+//     ln Z_k = ln sum_{B,M} N(B, M) exp(-beta_k E_k) / sum_j n_j exp(-beta_j E_j - ln Z_j)
+// iterated until the largest change drops below tolerance.
+DensityOfStates density_from_histograms(const std::vector<EnergyHistogram>& histograms,
+                                        const ReweightingParams& params,
+                                        double tolerance = 1e-7, unsigned max_iterations = 10000)
+{
+	if (histograms.empty())
+	{
+		throw std::invalid_argument("density_from_histograms(): No histograms given");
+	}
+
+	// Merge all counts into one bin list:
+	std::unordered_map<int64_t, unsigned long> total_counts;
+	for (const EnergyHistogram& histogram : histograms)
+	{
+		for (const auto& bin : histogram.counts) total_counts[bin.first] += bin.second;
+	}
+
+	size_t num_bins = total_counts.size();
+	size_t num_runs = histograms.size();
+
+	DensityOfStates dos;
+	std::vector<double> log_counts;
+	for (const auto& bin : total_counts)
+	{
+		dos.bond_sums.push_back(EnergyHistogram::bond_sum(bin.first));
+		dos.spin_sums.push_back(EnergyHistogram::spin_sum(bin.first));
+		log_counts.push_back(log(static_cast<double>(bin.second)));
+	}
+
+	// -beta_k E_k(B, M) for every run and bin:
+	std::vector<double> minus_beta_energy(num_runs * num_bins);
+	std::vector<double> log_runs(num_runs);
+	for (size_t run = 0; run < num_runs; ++run)
+	{
+		double beta = 1.0 / (params.boltzmann * histograms[run].temperature);
+		for (size_t bin = 0; bin < num_bins; ++bin)
+		{
+			minus_beta_energy[run * num_bins + bin] =
+				-beta * configuration_energy(params, dos.bond_sums[bin], dos.spin_sums[bin], histograms[run].field);
+		}
+
+		log_runs[run] = histograms[run].num_measurements == 0? -INFINITY : log(histograms[run].num_measurements);
+	}
+
+	std::vector<double> log_z(num_runs, 0.0);
+	std::vector<double> log_denominator(num_bins);
+	std::vector<double> terms(std::max(num_runs, num_bins));
+
+	for (unsigned iteration = 0; iteration < max_iterations; ++iteration)
+	{
+		// Denominator of every bin:
+		terms.resize(num_runs);
+		for (size_t bin = 0; bin < num_bins; ++bin)
+		{
+			for (size_t run = 0; run < num_runs; ++run)
+			{
+				terms[run] = log_runs[run] + minus_beta_energy[run * num_bins + bin] - log_z[run];
+			}
+
+			log_denominator[bin] = log_sum_exp(terms);
+		}
+
+		// New partition functions (pinned to ln Z_0 = 0):
+		double max_change = 0.0;
+		double log_z_0 = 0.0;
+
+		terms.resize(num_bins);
+		for (size_t run = 0; run < num_runs; ++run)
+		{
+			for (size_t bin = 0; bin < num_bins; ++bin)
+			{
+				terms[bin] = log_counts[bin] + minus_beta_energy[run * num_bins + bin] - log_denominator[bin];
+			}
+
+			double new_log_z = log_sum_exp(terms);
+			if (run == 0) log_z_0 = new_log_z;
+			new_log_z -= log_z_0;
+
+			max_change = std::max(max_change, fabs(new_log_z - log_z[run]));
+			log_z[run] = new_log_z;
+		}
+
+		if (max_change < tolerance) break;
+	}
+
+	// ln g(B, M) = ln N(B, M) - denominator:
+	dos.log_g.resize(num_bins);
+	for (size_t bin = 0; bin < num_bins; ++bin)
+	{
+		dos.log_g[bin] = log_counts[bin] - log_denominator[bin];
+	}
+
+	return dos;
+}
+
+//=====================//
+// Reweighted Averages //
+//=====================//
+
+struct ReweightedPoint
+{
+	double temperature;
+	double field;
+
+	// Per site, magnetization in units of magnetic moment:
+	double magnetization;
+	double abs_magnetization;
+	double energy;
+
+	// Per site, in units of the Boltzmann constant:
+	double specific_heat;
+	// Per site, fluctuation of |M| in units of magnetic_moment^2 / kT:
+	double susceptibility;
+
+	// Probability of the bond sums next to a cut of the density of states:
+	double edge_weight;
+};
+
+// Above this edge weight the states beyond the cut would have mattered too:
+const double REWEIGHT_EDGE_WEIGHT_LIMIT = 1e-3;
+
+ReweightedPoint evaluate_density_of_states(const DensityOfStates& dos, const ReweightingParams& params,
+                                           double temperature, double field)
+{
+	double beta = 1.0 / (params.boltzmann * temperature);
+	size_t num_bins = dos.log_g.size();
+
+	std::vector<double> log_weight(num_bins);
+	for (size_t bin = 0; bin < num_bins; ++bin)
+	{
+		log_weight[bin] = dos.log_g[bin] - beta * configuration_energy(params, dos.bond_sums[bin], dos.spin_sums[bin], field);
+	}
+
+	double log_norm = log_sum_exp(log_weight);
+
+	double m = 0.0, abs_m = 0.0, m_2 = 0.0;
+	double e = 0.0, e_2 = 0.0;
+	double edge = 0.0;
+	for (size_t bin = 0; bin < num_bins; ++bin)
+	{
+		double probability = exp(log_weight[bin] - log_norm);
+
+		// Bond sums of one lattice share the parity, so a cut is followed by a bin at most one apart:
+		if (dos.bond_sums[bin] <= dos.cut_min + 1 || dos.bond_sums[bin] >= dos.cut_max - 1) edge += probability;
+
+		double energy = configuration_energy(params, dos.bond_sums[bin], dos.spin_sums[bin], field);
+		double spin   = dos.spin_sums[bin];
+
+		m     += probability * spin;
+		abs_m += probability * fabs(spin);
+		m_2   += probability * spin * spin;
+		e     += probability * energy;
+		e_2   += probability * energy * energy;
+	}
+
+	double sites = params.num_sites;
+
+	ReweightedPoint point;
+	point.temperature       = temperature;
+	point.field             = field;
+	point.magnetization     = m     / sites;
+	point.abs_magnetization = abs_m / sites;
+	point.energy            = e     / sites;
+	point.specific_heat     = beta * beta * (e_2 - e * e) / sites;
+	point.susceptibility    = beta * params.magnetic_moment * params.magnetic_moment * (m_2 - abs_m * abs_m) / sites;
+	point.edge_weight       = edge;
+
+	return point;
+}
+
+#endif // ISING_MODEL_REWEIGHTING_HPP_INCLUDED
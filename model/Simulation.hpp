@@ -0,0 +1,1575 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_SIMULATION_HPP_INCLUDED
+#define ISING_MODEL_SIMULATION_HPP_INCLUDED
+
+#include "Model.hpp"
+#include "Planner.hpp"
+#include "Progress.hpp"
+#include "Reweighting.hpp"
+#include "Snapshot.hpp"
+#include "ThreadCoreScalability.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/times.h>
+
+//==========================//
+// Parse Configuration File //
+//==========================//
+
+const double BOLTZMANN = 1.38e-23 /*Joules per Kelvin*/;
+
+// Both algorithms count time in Metropolis steps; n-fold way skips the rejected ones:
+enum Algorithm
+{
+	ALGORITHM_METROPOLIS = 0,
+	ALGORITHM_NFOLD      = 1
+};
+
+bool parse_algorithm(const char* name, Algorithm* algorithm)
+{
+	if (name == nullptr || algorithm == nullptr) return false;
+
+	if (strcmp(name, "metropolis") == 0) { *algorithm = ALGORITHM_METROPOLIS; return true; }
+	if (strcmp(name, "nfold"     ) == 0) { *algorithm = ALGORITHM_NFOLD;      return true; }
+
+	return false;
+}
+
+// A scan simulates every (T, H) point, Wang-Landau estimates g(B, M) once for all of them:
+enum SimulationMode
+{
+	SIMULATION_SCAN        = 0,
+	SIMULATION_WANG_LANDAU = 1
+};
+
+bool parse_simulation_mode(const char* name, SimulationMode* mode)
+{
+	if (name == nullptr || mode == nullptr) return false;
+
+	if (strcmp(name, "scan"       ) == 0) { *mode = SIMULATION_SCAN;        return true; }
+	if (strcmp(name, "wang_landau") == 0) { *mode = SIMULATION_WANG_LANDAU; return true; }
+
+	return false;
+}
+
+// Returns the number of flips:
+uint64_t advance_lattice(Lattice& lattice, Algorithm algorithm, unsigned steps)
+{
+	if (algorithm == ALGORITHM_NFOLD) return lattice.nfold_sweep     (steps);
+	else                              return lattice.metropolis_sweep(steps);
+}
+
+// Invoked on the worker thread as soon as a sample is finished.
+// The lattice may only be inspected until the callback returns.
+typedef void (*SampleCallback)(const Lattice& lattice, unsigned sample, int thread_index,
+                               float temperature, float field, void* user_data);
+
+struct ComputationParams
+{
+	// Computation parameters:
+	float interactivity;
+	float magnetic_moment;
+	int size_x, size_y, size_z, size_w;
+	LatticeLayout layout;
+	Geometry geometry;
+	Boundary boundary;
+	Algorithm algorithm;
+	SimulationMode simulation;
+
+	// Initial state of every sample (start_bias is the share of spins +1 for biased starts):
+	LatticeStart start;
+	float start_bias;
+
+	// Quenched disorder, a fresh realization for every sample (disabled if all shares are 0):
+	DisorderParams disorder;
+	float random_field;
+	unsigned disorder_seed;
+
+	// Sampling parameters:
+	float  temp_min,  temp_max,  temp_step;
+	float field_min, field_max, field_step;
+	unsigned samples_per_point;
+	unsigned steps_per_sample;
+	unsigned steps_per_render_frame;
+
+	// Histogram recording (disabled if histogram_measurements is 0):
+	unsigned histogram_measurements;
+	unsigned histogram_interval;
+
+	// Reweighting onto a dense output grid:
+	float  reweight_temp_min,  reweight_temp_max,  reweight_temp_step;
+	float reweight_field_min, reweight_field_max, reweight_field_step;
+	bool reweight_multi_histogram;
+	char reweight_output[256];
+
+	// Wang-Landau windows, one per thread (simulation wang_landau only):
+	WangLandauParams wang_landau;
+	char wang_landau_output[256];
+
+	// Lattice snapshots (disabled if snapshot_interval is 0):
+	unsigned snapshot_interval;
+	unsigned snapshot_keyframe_interval;
+	bool snapshot_delta;
+	char snapshot_output[256];
+
+	// Live status file (disabled if status_file is empty):
+	char status_file[256];
+	unsigned status_interval_ms;
+
+	// Threading parameters:
+	int num_threads;
+	ParallelismMode parallelism;
+
+	// Place to save samples:
+	double* samples_to_save;
+	EnergyHistogram* histograms_to_save;
+	SnapshotWriter* snapshot_writer;
+	ThreadProgress* progress;
+
+	// Per-sample hook (disabled if nullptr):
+	SampleCallback sample_callback;
+	void* sample_callback_data;
+};
+
+ComputationParams parse_config_file(const char* config_filename)
+{
+	FILE* config_file = std::fopen(config_filename, "r");
+	if (config_file == nullptr)
+	{
+		fprintf(stderr, "[ISING-MODEL] Unable to open config file!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ComputationParams comp_info;
+
+	// Model parameters:
+	comp_info.interactivity   = 1.0;
+	comp_info.magnetic_moment = 1.0;
+	comp_info.size_x = 20;
+	comp_info.size_y = 20;
+	comp_info.size_z = 20;
+
+	fscanf(config_file,   "interactivity %f\n", &comp_info.interactivity);
+	fscanf(config_file, "magnetic_moment %f\n", &comp_info.magnetic_moment);
+	fscanf(config_file,  "size (%u, %u, %u)\n", &comp_info.size_x, &comp_info.size_y, &comp_info.size_z);
+
+	comp_info.interactivity *= 1.6e-19 /*Joules*/; 
+
+	// Sampling parameters:
+	comp_info.temp_min  = 100.0;
+	comp_info.temp_max  = 100.0;
+	comp_info.temp_step = 100.0;
+	comp_info.field_min   = 0.0;
+	comp_info.field_max   = 0.0;
+	comp_info. field_step = 0.0;
+
+	comp_info.samples_per_point      = 1;
+	comp_info.steps_per_sample       = 10000000;
+	comp_info.steps_per_render_frame = 50000;
+
+	fscanf(config_file, "T [%f : %f : %f]\n",  &comp_info.temp_min,  &comp_info.temp_max,  &comp_info.temp_step);
+	fscanf(config_file, "H [%f : %f : %f]\n", &comp_info.field_min, &comp_info.field_max, &comp_info.field_step);
+	fscanf(config_file,      "samples_per_point %u\n", &comp_info.samples_per_point);
+	fscanf(config_file,       "steps_per_sample %u\n", &comp_info.steps_per_sample);
+	fscanf(config_file, "steps_per_render_frame %u\n", &comp_info.steps_per_render_frame);
+
+	// Optional settings, one "<key> <value>" pair per line:
+	comp_info.layout   = LAYOUT_ROW_MAJOR;
+	comp_info.geometry = GEOMETRY_SIMPLE_CUBIC;
+	comp_info.boundary = BOUNDARY_PERIODIC;
+	comp_info.algorithm = ALGORITHM_METROPOLIS;
+	comp_info.simulation = SIMULATION_SCAN;
+	comp_info.start      = START_RANDOM;
+	comp_info.start_bias = 0.5;
+	comp_info.size_w   = 1;
+
+	comp_info.disorder.antiferro_fraction = 0.0;
+	comp_info.disorder.bond_dilution      = 0.0;
+	comp_info.disorder.site_dilution      = 0.0;
+	comp_info.disorder.random_field       = false;
+	comp_info.random_field  = 0.0;
+	comp_info.disorder_seed = 1;
+
+	comp_info.histogram_measurements = 0;
+	comp_info.histogram_interval     = 0; /* Lattice volume by default */
+
+	comp_info.reweight_temp_min  = comp_info.temp_min;
+	comp_info.reweight_temp_max  = comp_info.temp_max;
+	comp_info.reweight_temp_step = comp_info.temp_step;
+	comp_info.reweight_field_min  = comp_info.field_min;
+	comp_info.reweight_field_max  = comp_info.field_max;
+	comp_info.reweight_field_step = comp_info.field_step;
+	comp_info.reweight_multi_histogram = true;
+	comp_info.reweight_output[0] = '\0';
+
+	comp_info.wang_landau.bond_min_share = -1.0;
+	comp_info.wang_landau.bond_max_share = 1.0;
+	comp_info.wang_landau.overlap        = 0.75;
+	comp_info.wang_landau.flatness       = 0.8;
+	comp_info.wang_landau.final_log_f    = 1e-6;
+	comp_info.wang_landau.max_sweeps     = 1000000;
+	comp_info.wang_landau_output[0] = '\0';
+
+	comp_info.snapshot_interval          = 0;
+	comp_info.snapshot_keyframe_interval = 16;
+	comp_info.snapshot_delta             = true;
+	strcpy(comp_info.snapshot_output, "snapshots");
+
+	comp_info.status_file[0]     = '\0';
+	comp_info.status_interval_ms = 1000;
+
+	comp_info.parallelism = PARALLELISM_AUTO;
+
+	char line[512];
+	while (fgets(line, sizeof(line), config_file) != nullptr)
+	{
+		char key[64];
+		char value[448];
+		int parsed = sscanf(line, "%63s %447[^\n]", key, value);
+		if (parsed <= 0) continue;
+		if (parsed != 2)
+		{
+			fprintf(stderr, "[ISING-MODEL] Config option \"%s\" has no value!\n", key);
+			exit(EXIT_FAILURE);
+		}
+
+		if (strcmp(key, "layout") == 0)
+		{
+			if (!parse_lattice_layout(value, &comp_info.layout))
+			{
+				fprintf(stderr, "[ISING-MODEL] Unknown lattice layout \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "geometry") == 0)
+		{
+			if (!parse_geometry(value, &comp_info.geometry))
+			{
+				fprintf(stderr, "[ISING-MODEL] Unknown lattice geometry \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "boundary") == 0)
+		{
+			if (!parse_boundary(value, &comp_info.boundary))
+			{
+				fprintf(stderr, "[ISING-MODEL] Unknown boundary \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "algorithm") == 0)
+		{
+			if (!parse_algorithm(value, &comp_info.algorithm))
+			{
+				fprintf(stderr, "[ISING-MODEL] Unknown algorithm \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "simulation") == 0)
+		{
+			if (!parse_simulation_mode(value, &comp_info.simulation))
+			{
+				fprintf(stderr, "[ISING-MODEL] Unknown simulation \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "start") == 0)
+		{
+			if (!parse_lattice_start(value, &comp_info.start))
+			{
+				fprintf(stderr, "[ISING-MODEL] Unknown start \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "start_bias") == 0)
+		{
+			if (sscanf(value, "%f", &comp_info.start_bias) != 1 || !(comp_info.start_bias >= 0.0 && comp_info.start_bias <= 1.0))
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid start_bias \"%s\": expected a share in [0, 1]!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "size_w") == 0)
+		{
+			if (sscanf(value, "%d", &comp_info.size_w) != 1 || comp_info.size_w <= 0)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid size_w \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "antiferro_fraction") == 0 || strcmp(key, "bond_dilution") == 0 ||
+		         strcmp(key, "site_dilution"     ) == 0)
+		{
+			float* share = strcmp(key, "antiferro_fraction") == 0? &comp_info.disorder.antiferro_fraction :
+			               strcmp(key, "bond_dilution"     ) == 0? &comp_info.disorder.bond_dilution      :
+			                                                        &comp_info.disorder.site_dilution;
+			if (sscanf(value, "%f", share) != 1 || !(*share >= 0.0 && *share <= 1.0))
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid %s \"%s\": expected a share in [0, 1]!\n", key, value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "random_field") == 0)
+		{
+			if (sscanf(value, "%f", &comp_info.random_field) != 1 || comp_info.random_field < 0.0)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid random_field \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+
+			comp_info.disorder.random_field = comp_info.random_field > 0.0;
+		}
+		else if (strcmp(key, "disorder_seed") == 0)
+		{
+			if (sscanf(value, "%u", &comp_info.disorder_seed) != 1)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid disorder_seed \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "histogram_measurements") == 0)
+		{
+			if (sscanf(value, "%u", &comp_info.histogram_measurements) != 1)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid histogram_measurements \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "histogram_interval") == 0)
+		{
+			if (sscanf(value, "%u", &comp_info.histogram_interval) != 1 || comp_info.histogram_interval == 0)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid histogram_interval \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "reweight_T") == 0)
+		{
+			if (sscanf(value, "[%f : %f : %f]", &comp_info.reweight_temp_min, &comp_info.reweight_temp_max,
+			                                    &comp_info.reweight_temp_step) != 3 || comp_info.reweight_temp_step <= 0.0)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid reweight_T \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "reweight_H") == 0)
+		{
+			if (sscanf(value, "[%f : %f : %f]", &comp_info.reweight_field_min, &comp_info.reweight_field_max,
+			                                    &comp_info.reweight_field_step) != 3 || comp_info.reweight_field_step <= 0.0)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid reweight_H \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "reweight_method") == 0)
+		{
+			if      (strcmp(value, "single") == 0) comp_info.reweight_multi_histogram = false;
+			else if (strcmp(value, "multi" ) == 0) comp_info.reweight_multi_histogram = true;
+			else
+			{
+				fprintf(stderr, "[ISING-MODEL] Unknown reweight_method \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "reweight_output") == 0)
+		{
+			if (strlen(value) >= sizeof(comp_info.reweight_output))
+			{
+				fprintf(stderr, "[ISING-MODEL] Path in reweight_output is too long!\n");
+				exit(EXIT_FAILURE);
+			}
+
+			strcpy(comp_info.reweight_output, value);
+		}
+		else if (strcmp(key, "wang_landau_bonds") == 0)
+		{
+			float& share_min = comp_info.wang_landau.bond_min_share;
+			float& share_max = comp_info.wang_landau.bond_max_share;
+			if (sscanf(value, "[%f : %f]", &share_min, &share_max) != 2 ||
+			    !(share_min >= -1.0 && share_min < share_max && share_max <= 1.0))
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid wang_landau_bonds \"%s\": expected [min : max] within [-1 : 1]!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "wang_landau_overlap") == 0)
+		{
+			if (sscanf(value, "%f", &comp_info.wang_landau.overlap) != 1 ||
+			    !(comp_info.wang_landau.overlap > 0.0 && comp_info.wang_landau.overlap < 1.0))
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid wang_landau_overlap \"%s\": expected a share in (0, 1)!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "wang_landau_flatness") == 0)
+		{
+			if (sscanf(value, "%f", &comp_info.wang_landau.flatness) != 1 ||
+			    !(comp_info.wang_landau.flatness > 0.0 && comp_info.wang_landau.flatness < 1.0))
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid wang_landau_flatness \"%s\": expected a share in (0, 1)!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "wang_landau_final_f") == 0)
+		{
+			if (sscanf(value, "%lf", &comp_info.wang_landau.final_log_f) != 1 || !(comp_info.wang_landau.final_log_f > 0.0))
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid wang_landau_final_f \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "wang_landau_max_sweeps") == 0)
+		{
+			if (sscanf(value, "%u", &comp_info.wang_landau.max_sweeps) != 1 || comp_info.wang_landau.max_sweeps == 0)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid wang_landau_max_sweeps \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "wang_landau_output") == 0)
+		{
+			if (strlen(value) >= sizeof(comp_info.wang_landau_output))
+			{
+				fprintf(stderr, "[ISING-MODEL] Path in wang_landau_output is too long!\n");
+				exit(EXIT_FAILURE);
+			}
+
+			strcpy(comp_info.wang_landau_output, value);
+		}
+		else if (strcmp(key, "snapshot_interval") == 0)
+		{
+			if (sscanf(value, "%u", &comp_info.snapshot_interval) != 1)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid snapshot_interval \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "snapshot_keyframe_interval") == 0)
+		{
+			if (sscanf(value, "%u", &comp_info.snapshot_keyframe_interval) != 1 || comp_info.snapshot_keyframe_interval == 0)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid snapshot_keyframe_interval \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "snapshot_delta") == 0)
+		{
+			if      (strcmp(value, "on" ) == 0) comp_info.snapshot_delta = true;
+			else if (strcmp(value, "off") == 0) comp_info.snapshot_delta = false;
+			else
+			{
+				fprintf(stderr, "[ISING-MODEL] Expected on/off for snapshot_delta!\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "snapshot_output") == 0)
+		{
+			if (strlen(value) >= sizeof(comp_info.snapshot_output))
+			{
+				fprintf(stderr, "[ISING-MODEL] Path in snapshot_output is too long!\n");
+				exit(EXIT_FAILURE);
+			}
+
+			strcpy(comp_info.snapshot_output, value);
+		}
+		else if (strcmp(key, "status_file") == 0)
+		{
+			if (strlen(value) >= sizeof(comp_info.status_file))
+			{
+				fprintf(stderr, "[ISING-MODEL] Path in status_file is too long!\n");
+				exit(EXIT_FAILURE);
+			}
+
+			strcpy(comp_info.status_file, value);
+		}
+		else if (strcmp(key, "status_interval_ms") == 0)
+		{
+			if (sscanf(value, "%u", &comp_info.status_interval_ms) != 1 || comp_info.status_interval_ms == 0)
+			{
+				fprintf(stderr, "[ISING-MODEL] Invalid status_interval_ms \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(key, "parallelism") == 0)
+		{
+			if (!parse_parallelism_mode(value, &comp_info.parallelism))
+			{
+				fprintf(stderr, "[ISING-MODEL] Unknown parallelism \"%s\"!\n", value);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else
+		{
+			fprintf(stderr, "[ISING-MODEL] Unknown config option \"%s\"!\n", key);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	fclose(config_file);
+
+	if (comp_info.histogram_interval == 0)
+	{
+		comp_info.histogram_interval = comp_info.size_x * comp_info.size_y * comp_info.size_z * comp_info.size_w;
+	}
+
+	// Check lattice shape against geometry:
+	int dims = geometry_dimensions(comp_info.geometry);
+	if ((dims < 4 && comp_info.size_w != 1) || (dims < 3 && comp_info.size_z != 1))
+	{
+		fprintf(stderr, "[ISING-MODEL] Lattice geometry \"%s\" is %dD: unused sizes must be 1!\n",
+		        geometry_name(comp_info.geometry), dims);
+		exit(EXIT_FAILURE);
+	}
+
+	// Histograms only hold the bond and spin sums, which miss the sum of h_i s_i:
+	if (comp_info.disorder.random_field && comp_info.histogram_measurements != 0)
+	{
+		fprintf(stderr, "[ISING-MODEL] Histograms can not be reweighted with random fields!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (comp_info.disorder.random_field && comp_info.simulation == SIMULATION_WANG_LANDAU)
+	{
+		fprintf(stderr, "[ISING-MODEL] Wang-Landau sampling does not support random fields!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Walkers have neither samples to snapshot or histogram nor a scan to report progress of:
+	if (comp_info.simulation == SIMULATION_WANG_LANDAU &&
+	    (comp_info.snapshot_interval != 0 || comp_info.status_file[0] != '\0' || comp_info.histogram_measurements != 0))
+	{
+		fprintf(stderr, "[ISING-MODEL] Wang-Landau sampling does not support snapshots, status files or histograms!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (comp_info.parallelism == PARALLELISM_TEAMS &&
+	    (comp_info.boundary != BOUNDARY_PERIODIC || comp_info.algorithm != ALGORITHM_METROPOLIS))
+	{
+		fprintf(stderr, "[ISING-MODEL] Thread teams require periodic boundaries and the metropolis algorithm!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (comp_info.boundary == BOUNDARY_HELICAL)
+	{
+		if (comp_info.layout != LAYOUT_ROW_MAJOR)
+		{
+			fprintf(stderr, "[ISING-MODEL] Helical boundaries require the row_major layout!\n");
+			exit(EXIT_FAILURE);
+		}
+
+		int sizes[LATTICE_MAX_DIMS] = {comp_info.size_x, comp_info.size_y, comp_info.size_z, comp_info.size_w};
+		int deltas[STENCIL_MAX_NEIGHBOURS];
+		if (geometry_helical_deltas(comp_info.geometry, sizes, deltas) > sizes[0] * sizes[1] * sizes[2] * sizes[3])
+		{
+			fprintf(stderr, "[ISING-MODEL] Lattice is too small for helical boundaries!\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return comp_info;
+}
+
+//==================//
+// Computation Core //
+//==================//
+
+// One (T, H, sample) point of the scan, index is the global sample index:
+struct SampleTask
+{
+	float temperature;
+	float field;
+	unsigned index;
+};
+
+// Threads sharing the lattice of the leader (member 0). Member m sweeps slabs 2m and 2m + 1,
+// slab s spanning x in [slab_bounds[s], slab_bounds[s + 1]):
+struct SampleTeam
+{
+	Lattice* lattice;
+	int size;
+	std::vector<int> slab_bounds;
+
+	// Guarded by the scheduler mutex:
+	int joined;
+	int attached;
+
+	// Written by the leader before the barrier that starts an advance or a fill:
+	unsigned steps;
+	bool finished;
+	bool initializing;
+	float temperature;
+	float field;
+
+	LatticeStart start;
+	float start_bias;
+	uint64_t start_seed;
+
+	pthread_barrier_t barrier;
+};
+
+// Shared task queue. At most one team recruits at a time, and free threads join it before
+// taking new tasks, so a recruiting leader only waits for threads finishing their own samples:
+struct SampleScheduler
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+
+	std::vector<SampleTask> tasks;
+	unsigned next_task;
+
+	ParallelPlan plan;
+	int num_threads;
+	int team_threads; // Threads inside teams of two or more
+	SampleTeam* recruiting;
+
+	// First failure of a worker, reported by try_run_simulation():
+	bool failed;
+	std::string error;
+};
+
+// Called with the mutex held. The queue is emptied, so no new samples are started,
+// while running samples and recruiting teams still finish normally:
+void fail_scheduler(SampleScheduler* scheduler, const char* error)
+{
+	if (!scheduler->failed)
+	{
+		scheduler->failed = true;
+		scheduler->error  = error;
+	}
+
+	scheduler->next_task = scheduler->tasks.size();
+}
+
+struct ThreadParams
+{
+	// Data necessary to init calculation:
+	int thread_index;
+	const ComputationParams* computation_parameters;
+	SampleScheduler* scheduler;
+};
+
+// Returns nullptr if the team barrier can not be created:
+SampleTeam* create_sample_team(Lattice* lattice, int size, const SampleTask& task)
+{
+	SampleTeam* team = new SampleTeam;
+	team->lattice  = lattice;
+	team->size     = size;
+	team->joined   = 1;
+	team->attached = 0;
+	team->steps    = 0;
+	team->finished = false;
+	team->initializing = false;
+	team->start        = START_RANDOM;
+	team->start_bias   = 0.5;
+	team->start_seed   = 0;
+	team->temperature = task.temperature;
+	team->field       = task.field;
+
+	int sizes[LATTICE_MAX_DIMS];
+	lattice->get_sizes(sizes);
+	for (int slab = 0; slab <= 2 * size; ++slab) team->slab_bounds.push_back(slab * sizes[0] / (2 * size));
+
+	if (pthread_barrier_init(&team->barrier, nullptr, size) != 0)
+	{
+		delete team;
+		return nullptr;
+	}
+
+	return team;
+}
+
+// Even slabs in one phase, odd slabs in the next. Long advances are cut into rounds of about
+// one sweep, so the slabs keep exchanging their borders. Slab shares telescope to exactly steps:
+void sweep_team_slabs(SampleTeam* team, int member, std::mt19937& slab_gen, ThreadProgress* progress)
+{
+	uint64_t num_sites = team->lattice->get_num_sites();
+	uint64_t rounds = std::max<uint64_t>(1, (team->steps + num_sites - 1) / num_sites);
+	uint64_t size_x = team->slab_bounds.back();
+
+	uint64_t swept = 0;
+	uint64_t flips = 0;
+	for (uint64_t round = 0; round < rounds; ++round)
+	{
+		for (int parity = 0; parity < 2; ++parity)
+		{
+			int x_begin = team->slab_bounds[2 * member + parity];
+			int x_end   = team->slab_bounds[2 * member + parity + 1];
+
+			uint64_t slab_steps  = team->steps * x_end / size_x - team->steps * x_begin / size_x;
+			uint64_t phase_steps = slab_steps / rounds + (round < slab_steps % rounds? 1 : 0);
+
+			flips += team->lattice->metropolis_sweep_slab(x_begin, x_end, phase_steps, slab_gen);
+			swept += phase_steps;
+
+			pthread_barrier_wait(&team->barrier);
+		}
+	}
+
+	progress_add_steps(progress, swept, flips);
+}
+
+void run_team_member(SampleTeam* team, int member, std::mt19937& slab_gen, ThreadProgress* progress)
+{
+	progress_start_task(progress, team->temperature, team->field);
+
+	while (true)
+	{
+		pthread_barrier_wait(&team->barrier);
+		if (team->finished) break;
+
+		if (team->initializing)
+		{
+			team->lattice->init_spins_chunk(team->start, team->start_bias, team->start_seed, member, team->size);
+			pthread_barrier_wait(&team->barrier);
+			continue;
+		}
+
+		sweep_team_slabs(team, member, slab_gen, progress);
+	}
+}
+
+// Team members fill a chunk of the storage each:
+void init_sample_spins(Lattice& lattice, const ComputationParams* comp_info, SampleTeam* team, std::mt19937& slab_gen)
+{
+	if (team == nullptr)
+	{
+		lattice.init_spins(comp_info->start, comp_info->start_bias);
+		return;
+	}
+
+	team->start        = comp_info->start;
+	team->start_bias   = comp_info->start_bias;
+	team->start_seed   = (static_cast<uint64_t>(slab_gen()) << 32) | slab_gen();
+	team->initializing = true;
+
+	pthread_barrier_wait(&team->barrier);
+	lattice.init_spins_chunk(team->start, team->start_bias, team->start_seed, 0, team->size);
+	pthread_barrier_wait(&team->barrier);
+
+	team->initializing = false;
+	lattice.init_spins_finish();
+}
+
+// Solo lattices run the configured algorithm, teams run slab sweeps:
+void advance_sample(Lattice& lattice, const ComputationParams* comp_info, SampleTeam* team, unsigned steps,
+                    std::mt19937& slab_gen, ThreadProgress* progress)
+{
+	if (team == nullptr)
+	{
+		uint64_t flips = advance_lattice(lattice, comp_info->algorithm, steps);
+		progress_add_steps(progress, steps, flips);
+		return;
+	}
+
+	lattice.prepare_slab_sweeps();
+	team->steps = steps;
+
+	pthread_barrier_wait(&team->barrier);
+	sweep_team_slabs(team, 0, slab_gen, progress);
+}
+
+void run_sample_task(const ComputationParams* comp_info, int thread_index, const SampleTask& task,
+                     Lattice& lattice, SampleTeam* team, std::vector<uint8_t>& packed_spins,
+                     std::mt19937& slab_gen, ThreadProgress* progress)
+{
+	bool snapshots = comp_info->snapshot_writer != nullptr && comp_info->snapshot_interval != 0;
+
+	// Sweeps are chunked only when someone looks in between:
+	unsigned chunk_size = comp_info->steps_per_sample;
+	if (progress != nullptr) chunk_size = std::min(chunk_size, PROGRESS_CHUNK_STEPS);
+	if (snapshots)           chunk_size = std::min(chunk_size, comp_info->snapshot_interval);
+
+	// Initialize lattice for exact computation:
+	lattice.temperature = task.temperature * BOLTZMANN;
+	lattice.field       = task.field       * comp_info->magnetic_moment;
+
+	// Sample k of every (T, H) point gets realization k, so every realization is simulated
+	// over the whole scan (and reweighted on its own, see save_reweighted_observables()):
+	if (disorder_enabled(comp_info->disorder))
+	{
+		lattice.random_field = comp_info->random_field * comp_info->magnetic_moment;
+		lattice.generate_disorder(comp_info->disorder, comp_info->disorder_seed + task.index % comp_info->samples_per_point);
+	}
+
+	init_sample_spins(lattice, comp_info, team, slab_gen);
+
+	progress_start_task(progress, task.temperature, task.field);
+
+	// Perform computation, publishing progress and dumping snapshots along the way:
+	uint32_t frame = 0;
+	uint64_t next_snapshot = comp_info->snapshot_interval;
+	for (unsigned steps_done = 0; steps_done < comp_info->steps_per_sample;)
+	{
+		unsigned chunk = std::min(chunk_size, comp_info->steps_per_sample - steps_done);
+		if (snapshots) chunk = std::min<uint64_t>(chunk, next_snapshot - steps_done);
+
+		advance_sample(lattice, comp_info, team, chunk, slab_gen, progress);
+		steps_done += chunk;
+
+		if (snapshots && (steps_done == next_snapshot || steps_done == comp_info->steps_per_sample))
+		{
+			lattice.pack_spins(packed_spins.data());
+			comp_info->snapshot_writer->submit(task.index, frame, steps_done, task.temperature, task.field,
+			                                   packed_spins.data(), steps_done == comp_info->steps_per_sample);
+
+			frame += 1;
+			next_snapshot += comp_info->snapshot_interval;
+		}
+	}
+
+	// Aggregate results:
+	comp_info->samples_to_save[3 * task.index + 0] = task.temperature;
+	comp_info->samples_to_save[3 * task.index + 1] = task.field;
+	comp_info->samples_to_save[3 * task.index + 2] = comp_info->magnetic_moment * lattice.calculate_average_spin();
+
+	// Record energy/magnetization histogram of the equilibrated lattice:
+	if (comp_info->histogram_measurements != 0 && comp_info->histograms_to_save != nullptr)
+	{
+		EnergyHistogram& histogram = comp_info->histograms_to_save[task.index];
+		histogram.temperature = task.temperature;
+		histogram.field       = task.field;
+
+		for (unsigned measurement = 0; measurement < comp_info->histogram_measurements; ++measurement)
+		{
+			advance_sample(lattice, comp_info, team, comp_info->histogram_interval, slab_gen, progress);
+			histogram.record(lattice.calculate_bond_sum(), lattice.calculate_total_spin());
+		}
+	}
+
+	// Hand the finished sample over to the embedding application:
+	if (comp_info->sample_callback != nullptr)
+	{
+		comp_info->sample_callback(lattice, task.index, thread_index, task.temperature, task.field,
+		                           comp_info->sample_callback_data);
+	}
+
+	progress_finish_task(progress);
+}
+
+// Code to be executed in a thread:
+void* compute_ising_model_sample(void* arg)
+{
+	// Check argument (without a scheduler there is nowhere to report to):
+	ThreadParams* thr_info = reinterpret_cast<ThreadParams*>(arg);
+	if (thr_info == nullptr || thr_info->scheduler == nullptr) return nullptr;
+
+	const ComputationParams* comp_info = thr_info->computation_parameters;
+	SampleScheduler* scheduler = thr_info->scheduler;
+
+	// Failures are reported through the scheduler. A thread left without a lattice of its own
+	// still serves in teams, as their leaders count on every thread coming back to the queue:
+	Lattice* lattice = nullptr;
+	std::vector<uint8_t> packed_spins;
+	std::mt19937 slab_gen(thr_info->thread_index);
+	try
+	{
+		if (comp_info == nullptr || comp_info->samples_to_save == nullptr)
+		{
+			throw std::invalid_argument("Computation parameter is invalid");
+		}
+
+		// Initialize lattice for computations (idle while the thread serves in another team):
+		lattice = new Lattice{comp_info->size_x, comp_info->size_y, comp_info->size_z, comp_info->interactivity, 0.0, 0.0,
+		                      comp_info->layout, comp_info->geometry, comp_info->size_w, comp_info->boundary};
+
+		// Buffer for bit-packed snapshots:
+		if (comp_info->snapshot_writer != nullptr && comp_info->snapshot_interval != 0)
+		{
+			packed_spins.resize(comp_info->snapshot_writer->get_packed_bytes());
+		}
+
+		// Slab sweeps of a team draw from per-thread generators:
+		std::random_device seed_source;
+		slab_gen.seed(seed_source());
+	}
+	catch (const std::bad_alloc&)
+	{
+		pthread_mutex_lock(&scheduler->mutex);
+		fail_scheduler(scheduler, "Unable to allocate sample lattice");
+		pthread_mutex_unlock(&scheduler->mutex);
+	}
+	catch (const std::exception& error)
+	{
+		pthread_mutex_lock(&scheduler->mutex);
+		fail_scheduler(scheduler, error.what());
+		pthread_mutex_unlock(&scheduler->mutex);
+	}
+
+	// Counters watched by the status reporter:
+	ThreadProgress* progress = comp_info == nullptr || comp_info->progress == nullptr? nullptr :
+	                           &comp_info->progress[thr_info->thread_index];
+
+	pthread_mutex_lock(&scheduler->mutex);
+	while (true)
+	{
+		// Join the recruiting team first:
+		if (scheduler->recruiting != nullptr)
+		{
+			SampleTeam* team = scheduler->recruiting;
+			int member = team->joined;
+			team->joined   += 1;
+			team->attached += 1;
+
+			if (team->joined == team->size)
+			{
+				scheduler->recruiting = nullptr;
+				pthread_cond_broadcast(&scheduler->cond);
+			}
+
+			pthread_mutex_unlock(&scheduler->mutex);
+			run_team_member(team, member, slab_gen, progress);
+			pthread_mutex_lock(&scheduler->mutex);
+
+			team->attached -= 1;
+			pthread_cond_broadcast(&scheduler->cond);
+			continue;
+		}
+
+		if (scheduler->next_task == scheduler->tasks.size()) break;
+
+		SampleTask task = scheduler->tasks[scheduler->next_task];
+		scheduler->next_task += 1;
+
+		// Threads of other teams are busy for a whole sample, threads running solo samples are about to be free:
+		unsigned remaining_tasks = scheduler->tasks.size() - scheduler->next_task + 1;
+		int team_size = plan_team_size(scheduler->plan, scheduler->num_threads - scheduler->team_threads, remaining_tasks);
+
+		SampleTeam* team = nullptr;
+		if (team_size > 1)
+		{
+			team = create_sample_team(lattice, team_size, task);
+			if (team == nullptr)
+			{
+				fail_scheduler(scheduler, "Unable to create team barrier");
+				continue;
+			}
+
+			scheduler->team_threads += team_size;
+			scheduler->recruiting = team;
+
+			while (team->joined < team->size) pthread_cond_wait(&scheduler->cond, &scheduler->mutex);
+		}
+
+		pthread_mutex_unlock(&scheduler->mutex);
+
+		// Members wait for the next command of the leader between the steps of a sample,
+		// so a sample that throws still releases them below:
+		std::string task_error;
+		bool task_failed = false;
+		try
+		{
+			run_sample_task(comp_info, thr_info->thread_index, task, *lattice, team, packed_spins, slab_gen, progress);
+		}
+		catch (const std::bad_alloc&)
+		{
+			task_failed = true;
+			task_error  = "Unable to allocate memory for a sample";
+		}
+		catch (const std::exception& error)
+		{
+			task_failed = true;
+			task_error  = error.what();
+		}
+
+		// Release the members and wait until they leave the team:
+		if (team != nullptr)
+		{
+			team->finished = true;
+			pthread_barrier_wait(&team->barrier);
+		}
+
+		pthread_mutex_lock(&scheduler->mutex);
+
+		if (task_failed) fail_scheduler(scheduler, task_error.c_str());
+
+		if (team != nullptr)
+		{
+			while (team->attached > 0) pthread_cond_wait(&scheduler->cond, &scheduler->mutex);
+
+			scheduler->team_threads -= team->size;
+			pthread_barrier_destroy(&team->barrier);
+			delete team;
+		}
+	}
+	pthread_mutex_unlock(&scheduler->mutex);
+
+	delete lattice;
+
+	return nullptr;
+}
+
+//=====================//
+// Simulation Launcher //
+//=====================//
+
+unsigned count_samples(const ComputationParams* comp_info)
+{
+	unsigned num_samples = 0;
+	for (float  temp_cur = comp_info-> temp_min;  temp_cur < comp_info-> temp_max;  temp_cur += comp_info-> temp_step) {
+	for (float field_cur = comp_info->field_min; field_cur < comp_info->field_max; field_cur += comp_info->field_step)
+	{
+		for (unsigned sample = 0; sample < comp_info->samples_per_point; ++sample)
+		{
+			num_samples += 1;
+		}
+	}}
+
+	return num_samples;
+}
+
+// Planner input of the scan. Slab sweeps exist for periodic Metropolis runs only:
+ParallelPlan plan_simulation(const ComputationParams* comp_info)
+{
+	int num_sites = comp_info->size_x * comp_info->size_y * comp_info->size_z * comp_info->size_w;
+
+	PlannerInput input;
+	input.mode            = comp_info->parallelism;
+	input.teams_supported = comp_info->boundary == BOUNDARY_PERIODIC && comp_info->algorithm == ALGORITHM_METROPOLIS;
+	input.size_x          = comp_info->size_x;
+	input.num_sites       = num_sites;
+	input.lattice_bytes   = num_sites;
+	input.num_tasks       = count_samples(comp_info);
+	input.num_threads     = comp_info->num_threads;
+
+	// Disordered lattices stream a coupling plane per neighbour and the field signs:
+	if (disorder_enabled(comp_info->disorder))
+	{
+		input.lattice_bytes += 1ULL * num_sites * (geometry_neighbours(comp_info->geometry) + 1);
+	}
+
+	return plan_parallelism(input, read_cache_topology());
+}
+
+struct SimulationTimes
+{
+	float   user_time;
+	float kernel_time;
+	float   real_time;
+};
+
+// Runs the whole (T, H) scan on comp_info->num_threads anchored threads.
+// Threads take samples from a shared queue, alone or in teams as planned by plan_simulation().
+// comp_info->samples_to_save must have room for 3 * count_samples() doubles.
+// Hardware threads are handed out starting from cpu_info->current_hart.
+// Reports failures instead of exiting: returns false with the message in error.
+bool try_run_simulation(const ComputationParams* comp_info, CpuInfo* cpu_info, bool spawn_parasites,
+                        SimulationTimes* sim_times, std::string* error)
+{
+	if (comp_info == nullptr || cpu_info == nullptr || comp_info->samples_to_save == nullptr || sim_times == nullptr)
+	{
+		*error = "Invalid simulation arguments";
+		return false;
+	}
+
+	int num_threads = comp_info->num_threads;
+
+	// Threads see the progress counters through a private copy of the parameters:
+	ComputationParams run_info = *comp_info;
+	run_info.progress = nullptr;
+
+	//====================//
+	// Allocate Resources //
+	//====================//
+
+	// Allocate thread parameters array:
+	ThreadParams* thread_params = (ThreadParams*) calloc(num_threads, sizeof(*thread_params));
+	if (thread_params == nullptr)
+	{
+		*error = "Unable to allocate memory for thread parameters";
+		return false;
+	}
+
+	// Queue the scan in the usual (T, H, sample) order:
+	SampleScheduler scheduler;
+	pthread_mutex_init(&scheduler.mutex, nullptr);
+	pthread_cond_init (&scheduler.cond,  nullptr);
+	scheduler.next_task    = 0;
+	scheduler.plan         = plan_simulation(comp_info);
+	scheduler.num_threads  = num_threads;
+	scheduler.team_threads = 0;
+	scheduler.recruiting   = nullptr;
+	scheduler.failed       = false;
+
+	for (float  temp_cur = comp_info-> temp_min;  temp_cur < comp_info-> temp_max;  temp_cur += comp_info-> temp_step) {
+	for (float field_cur = comp_info->field_min; field_cur < comp_info->field_max; field_cur += comp_info->field_step)
+	{
+		for (unsigned sample = 0; sample < comp_info->samples_per_point; ++sample)
+		{
+			SampleTask task;
+			task.temperature = temp_cur;
+			task.field       = field_cur;
+			task.index       = scheduler.tasks.size();
+			scheduler.tasks.push_back(task);
+		}
+	}}
+
+	for (int i = 0; i < num_threads; ++i)
+	{
+		thread_params[i].thread_index = i;
+		thread_params[i].computation_parameters = &run_info;
+		thread_params[i].scheduler = &scheduler;
+	}
+
+	// Data necessary to wait for thread completion:
+	pthread_t* thread_table = (pthread_t*) calloc(num_threads, sizeof(*thread_table));
+	if (thread_table == nullptr)
+	{
+		free(thread_params);
+		pthread_mutex_destroy(&scheduler.mutex);
+		pthread_cond_destroy (&scheduler.cond);
+
+		*error = "Unable to allocate thread table";
+		return false;
+	}
+
+	//=========================//
+	// Start Time Measurements //
+	//=========================//
+
+	struct tms time_start;
+	long real_time_start = times(&time_start);
+
+	long ticks_in_one_second = sysconf(_SC_CLK_TCK);
+
+	//=======================//
+	// Start Status Reporter //
+	//=======================//
+
+	bool started = true;
+
+	ProgressReporter* reporter = nullptr;
+	if (comp_info->status_file[0] != '\0')
+	{
+		uint64_t num_samples = count_samples(comp_info);
+		uint64_t steps_per_task = comp_info->steps_per_sample;
+		if (comp_info->histogram_measurements != 0 && comp_info->histograms_to_save != nullptr)
+		{
+			steps_per_task += 1ULL * comp_info->histogram_measurements * comp_info->histogram_interval;
+		}
+
+		run_info.progress = allocate_thread_progress(num_threads);
+
+		try
+		{
+			reporter = new ProgressReporter{run_info.progress, num_threads, num_samples, num_samples * steps_per_task,
+			                                comp_info->status_file, comp_info->status_interval_ms};
+		}
+		catch (const std::exception& reporter_error)
+		{
+			*error = reporter_error.what();
+			started = false;
+		}
+	}
+
+	//====================//
+	// Start Calculations //
+	//====================//
+
+	// Threads queue up on the scheduler until all of them are running. If one fails to start,
+	// the queue is emptied, so the others leave at once instead of waiting for team members:
+	int num_started = 0;
+	pthread_mutex_lock(&scheduler.mutex);
+	for (int thr = 0; thr < num_threads && started; ++thr)
+	{
+		// Aquire harware threads to run on:
+		cpu_set_t availible_harts = assign_hardware_thread(cpu_info);
+
+		// Start computation:
+		const char* thread_error = nullptr;
+		started = try_create_anchored_thread(&thread_table[thr],
+		                                     compute_ising_model_sample,
+		                                     &thread_params[thr],
+		                                     &availible_harts,
+		                                     &thread_error);
+		if (started) num_started += 1;
+		else         *error = thread_error;
+	}
+
+	if (!started) scheduler.next_task = scheduler.tasks.size();
+	pthread_mutex_unlock(&scheduler.mutex);
+
+	//========================//
+	// Spawn Parasite Threads //
+	//========================//
+
+	if (spawn_parasites && started) fill_with_parasite_threads(cpu_info);
+
+	//=====================//
+	// Wait For Completion //
+	//=====================//
+
+	for (int thr = 0; thr < num_started; ++thr)
+	{
+		if (pthread_join(thread_table[thr], nullptr) != 0 && started)
+		{
+			*error = "Unable to join thread";
+			started = false;
+		}
+	}
+
+	if (started && scheduler.failed)
+	{
+		*error  = scheduler.error;
+		started = false;
+	}
+
+	// Final status is written when the reporter stops:
+	delete reporter;
+	free_thread_progress(run_info.progress, num_threads);
+
+	//==========================//
+	// Finish Time Measurements //
+	//==========================//
+
+	struct tms time_finish;
+	long real_time_finish = times(&time_finish);
+
+	sim_times->  user_time = 1.0 * (time_finish.tms_utime - time_start.tms_utime) / ticks_in_one_second;
+	sim_times->kernel_time = 1.0 * (time_finish.tms_stime - time_start.tms_stime) / ticks_in_one_second;
+	sim_times->  real_time = 1.0 * (real_time_finish      -      real_time_start) / ticks_in_one_second;
+
+	//======================//
+	// Deallocate Resources //
+	//======================//
+
+	free(thread_params);
+	free(thread_table);
+
+	pthread_mutex_destroy(&scheduler.mutex);
+	pthread_cond_destroy (&scheduler.cond);
+
+	return started;
+}
+
+SimulationTimes run_simulation(const ComputationParams* comp_info, CpuInfo* cpu_info, bool spawn_parasites)
+{
+	SimulationTimes sim_times;
+	std::string error;
+	if (!try_run_simulation(comp_info, cpu_info, spawn_parasites, &sim_times, &error))
+	{
+		fprintf(stderr, "[ISING-MODEL] %s!\n", error.c_str());
+		exit(EXIT_FAILURE);
+	}
+
+	return sim_times;
+}
+
+//======================//
+// Wang-Landau Launcher //
+//======================//
+
+struct WangLandauThreadParams
+{
+	int thread_index;
+	const ComputationParams* computation_parameters;
+	int window_min;
+	int window_max;
+
+	// Allocated by the walker thread itself, so the window lives on its NUMA node:
+	WangLandauWalker* walker;
+};
+
+// Code to be executed in a thread:
+void* compute_wang_landau_window(void* arg)
+{
+	WangLandauThreadParams* thr_info = reinterpret_cast<WangLandauThreadParams*>(arg);
+	if (thr_info == nullptr || thr_info->computation_parameters == nullptr)
+	{
+		fprintf(stderr, "[ISING-MODEL] Computation parameter is invailid!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const ComputationParams* comp_info = thr_info->computation_parameters;
+	const WangLandauParams& params = comp_info->wang_landau;
+
+	Lattice lattice{comp_info->size_x, comp_info->size_y, comp_info->size_z, comp_info->interactivity, 0.0, 0.0,
+	                comp_info->layout, comp_info->geometry, comp_info->size_w, comp_info->boundary};
+
+	// All windows walk the same disorder realization:
+	if (disorder_enabled(comp_info->disorder))
+	{
+		lattice.generate_disorder(comp_info->disorder, comp_info->disorder_seed);
+	}
+
+	lattice.init_with_randoms();
+
+	WangLandauWalker* walker = new WangLandauWalker(thr_info->window_min, thr_info->window_max, lattice.get_num_sites());
+	walker->start(lattice.calculate_bond_sum(), lattice.calculate_total_spin());
+
+	// A flatness check is a pass over the window, so checks are spaced at least that many steps apart:
+	uint64_t num_sites = lattice.get_num_sites();
+	uint64_t check_interval = std::max<uint64_t>(num_sites, walker->log_g.size());
+	uint64_t max_steps = 1ULL * params.max_sweeps * num_sites;
+
+	for (uint64_t steps_done = 0; steps_done < max_steps && walker->log_f > params.final_log_f;)
+	{
+		unsigned chunk = std::min(check_interval, max_steps - steps_done);
+
+		lattice.wang_landau_sweep(*walker, chunk);
+		steps_done += chunk;
+
+		if (walker->histogram_flat(params.flatness)) walker->next_stage();
+	}
+
+	thr_info->walker = walker;
+
+	return nullptr;
+}
+
+// Splits the bond sum range of comp_info->wang_landau into comp_info->num_threads overlapping
+// windows and runs one walker per window on anchored threads. The walkers are handed over to
+// the caller, see merge_wang_landau_windows().
+SimulationTimes run_wang_landau(const ComputationParams* comp_info, CpuInfo* cpu_info,
+                                std::vector<WangLandauWalker*>* walkers)
+{
+	if (comp_info == nullptr || cpu_info == nullptr || walkers == nullptr || comp_info->num_threads <= 0)
+	{
+		fprintf(stderr, "[ISING-MODEL] Invalid simulation arguments!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	int num_threads = comp_info->num_threads;
+	int num_sites   = comp_info->size_x * comp_info->size_y * comp_info->size_z * comp_info->size_w;
+	int num_bonds   = num_sites * geometry_neighbours(comp_info->geometry) / 2;
+
+	std::vector<int> window_min;
+	std::vector<int> window_max;
+	wang_landau_windows(static_cast<int>(floor(comp_info->wang_landau.bond_min_share * num_bonds)),
+	                    static_cast<int>(ceil (comp_info->wang_landau.bond_max_share * num_bonds)),
+	                    num_threads, comp_info->wang_landau.overlap, &window_min, &window_max);
+
+	uint64_t window_bins = (window_max[0] - window_min[0]) / 2 + 1ULL;
+	if (window_bins * (num_sites + 1) > WANG_LANDAU_MAX_BINS)
+	{
+		fprintf(stderr, "[ISING-MODEL] Wang-Landau windows of %llu bins exceed the limit of %llu: "
+		        "use more threads, a narrower wang_landau_bonds range or a smaller lattice!\n",
+		        static_cast<unsigned long long>(window_bins * (num_sites + 1)),
+		        static_cast<unsigned long long>(WANG_LANDAU_MAX_BINS));
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<WangLandauThreadParams> thread_params(num_threads);
+	for (int i = 0; i < num_threads; ++i)
+	{
+		thread_params[i].thread_index = i;
+		thread_params[i].computation_parameters = comp_info;
+		thread_params[i].window_min = window_min[i];
+		thread_params[i].window_max = window_max[i];
+		thread_params[i].walker     = nullptr;
+	}
+
+	std::vector<pthread_t> thread_table(num_threads);
+
+	struct tms time_start;
+	long real_time_start = times(&time_start);
+
+	long ticks_in_one_second = sysconf(_SC_CLK_TCK);
+
+	for (int thr = 0; thr < num_threads; ++thr)
+	{
+		cpu_set_t availible_harts = assign_hardware_thread(cpu_info);
+
+		const char* thread_error = nullptr;
+		if (!try_create_anchored_thread(&thread_table[thr],
+		                                compute_wang_landau_window,
+		                                &thread_params[thr],
+		                                &availible_harts,
+		                                &thread_error))
+		{
+			fprintf(stderr, "[ISING-MODEL] %s!\n", thread_error);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (int thr = 0; thr < num_threads; ++thr)
+	{
+		if (pthread_join(thread_table[thr], nullptr) != 0)
+		{
+			fprintf(stderr, "[ISING-MODEL] Unable to join thread!\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	struct tms time_finish;
+	long real_time_finish = times(&time_finish);
+
+	SimulationTimes sim_times;
+	sim_times.  user_time = 1.0 * (time_finish.tms_utime - time_start.tms_utime) / ticks_in_one_second;
+	sim_times.kernel_time = 1.0 * (time_finish.tms_stime - time_start.tms_stime) / ticks_in_one_second;
+	sim_times.  real_time = 1.0 * (real_time_finish      -      real_time_start) / ticks_in_one_second;
+
+	walkers->clear();
+	for (int thr = 0; thr < num_threads; ++thr) walkers->push_back(thread_params[thr].walker);
+
+	return sim_times;
+}
+
+//=======================//
+// Histogram Reweighting //
+//=======================//
+
+ReweightingParams reweighting_params(const ComputationParams* comp_info)
+{
+	ReweightingParams params;
+	params.interactivity   = comp_info->interactivity;
+	params.magnetic_moment = comp_info->magnetic_moment;
+	params.boltzmann       = BOLTZMANN;
+	params.num_sites       = comp_info->size_x * comp_info->size_y * comp_info->size_z * comp_info->size_w;
+
+	return params;
+}
+
+// Writes observables on the reweight_T x reweight_H grid as a TSV table, averaged over the
+// reweighting sets (disorder realizations). Given several densities per set (single-histogram
+// reweighting), every grid point uses the one of the nearest simulated point:
+void write_reweighted_table(const ComputationParams* comp_info, const std::vector<std::vector<DensityOfStates>>& sets,
+                            const std::vector<EnergyHistogram>& points)
+{
+	FILE* output = fopen(comp_info->reweight_output, "w");
+	if (output == nullptr)
+	{
+		fprintf(stderr, "[ISING-MODEL] Unable to open reweighting output file!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ReweightingParams params = reweighting_params(comp_info);
+
+	unsigned num_points = 0;
+	unsigned cut_points = 0;
+
+	fprintf(output, "# T\tH\tmagnetization\tabs_magnetization\tenergy_per_site\tspecific_heat\tsusceptibility\n");
+
+	for (float  temp_cur = comp_info-> reweight_temp_min;  temp_cur < comp_info-> reweight_temp_max;  temp_cur += comp_info-> reweight_temp_step) {
+	for (float field_cur = comp_info->reweight_field_min; field_cur < comp_info->reweight_field_max; field_cur += comp_info->reweight_field_step)
+	{
+		// Single-histogram reweighting extrapolates from the nearest simulated point:
+		size_t nearest = 0;
+		if (sets[0].size() > 1)
+		{
+			double best_distance = INFINITY;
+			for (size_t point = 0; point < points.size(); ++point)
+			{
+				double d_temp  = (points[point].temperature - temp_cur ) / comp_info->temp_step;
+				double d_field = comp_info->field_step > 0.0? (points[point].field - field_cur) / comp_info->field_step : 0.0;
+				double distance = d_temp * d_temp + d_field * d_field;
+
+				if (distance < best_distance)
+				{
+					best_distance = distance;
+					nearest = point;
+				}
+			}
+		}
+
+		ReweightedPoint result = evaluate_density_of_states(sets[0][nearest], params, temp_cur, field_cur);
+		for (size_t set = 1; set < sets.size(); ++set)
+		{
+			ReweightedPoint other = evaluate_density_of_states(sets[set][nearest], params, temp_cur, field_cur);
+			result.magnetization     += other.magnetization;
+			result.abs_magnetization += other.abs_magnetization;
+			result.energy            += other.energy;
+			result.specific_heat     += other.specific_heat;
+			result.susceptibility    += other.susceptibility;
+			result.edge_weight       += other.edge_weight;
+		}
+
+		result.magnetization     /= sets.size();
+		result.abs_magnetization /= sets.size();
+		result.energy            /= sets.size();
+		result.specific_heat     /= sets.size();
+		result.susceptibility    /= sets.size();
+		result.edge_weight       /= sets.size();
+
+		num_points += 1;
+		if (result.edge_weight > REWEIGHT_EDGE_WEIGHT_LIMIT) cut_points += 1;
+
+		fprintf(output, "%.4f\t%.4f\t%.6e\t%.6e\t%.6e\t%.6e\t%.6e\n",
+		        result.temperature, result.field,
+		        comp_info->magnetic_moment * result.magnetization,
+		        comp_info->magnetic_moment * result.abs_magnetization,
+		        result.energy, result.specific_heat, result.susceptibility);
+	}}
+
+	fclose(output);
+
+	if (cut_points != 0)
+	{
+		fprintf(stderr, "[ISING-MODEL] %u of %u reweighted points put over %.0e of their weight at a cut of the density "
+		        "of states, their observables are biased: widen wang_landau_bonds!\n",
+		        cut_points, num_points, REWEIGHT_EDGE_WEIGHT_LIMIT);
+	}
+}
+
+// Merges the histograms of all samples of every simulated point and writes
+// reweighted observables on the reweight_T x reweight_H grid as a TSV table.
+// A reweighting set must stay within one Hamiltonian: disordered runs reweight
+// every realization on its own and average the observables over realizations.
+void save_reweighted_observables(const ComputationParams* comp_info, const EnergyHistogram* histograms,
+                                 unsigned num_samples)
+{
+	if (comp_info == nullptr || histograms == nullptr)
+	{
+		fprintf(stderr, "[ISING-MODEL] Invalid reweighting arguments!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ReweightingParams params = reweighting_params(comp_info);
+
+	// Samples of one point are stored next to each other, sample k holds realization k:
+	unsigned num_sets = disorder_enabled(comp_info->disorder)? comp_info->samples_per_point : 1;
+
+	std::vector<std::vector<DensityOfStates>> sets(num_sets);
+	std::vector<EnergyHistogram> points;
+	for (unsigned set = 0; set < num_sets; ++set)
+	{
+		points.clear();
+		for (unsigned sample = 0; sample < num_samples; ++sample)
+		{
+			unsigned index = sample % comp_info->samples_per_point;
+			if (num_sets > 1 && index != set) continue;
+
+			if (num_sets > 1 || index == 0) points.push_back(histograms[sample]);
+			else                            points.back().merge(histograms[sample]);
+		}
+
+		if (comp_info->reweight_multi_histogram)
+		{
+			sets[set].push_back(density_from_histograms(points, params));
+		}
+		else
+		{
+			for (const EnergyHistogram& point : points) sets[set].push_back(density_from_histogram(point, params));
+		}
+	}
+
+	write_reweighted_table(comp_info, sets, points);
+}
+
+// One ln g(B, M) per line, shifted to ln g = 0 at its minimum:
+void save_density_of_states(const char* filename, const DensityOfStates& dos)
+{
+	FILE* output = fopen(filename, "w");
+	if (output == nullptr)
+	{
+		fprintf(stderr, "[ISING-MODEL] Unable to open density of states output file!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	double min_log_g = INFINITY;
+	for (double log_g : dos.log_g) min_log_g = std::min(min_log_g, log_g);
+
+	fprintf(output, "# bond_sum\tspin_sum\tln_g\n");
+	for (size_t bin = 0; bin < dos.log_g.size(); ++bin)
+	{
+		fprintf(output, "%d\t%d\t%.10e\n", dos.bond_sums[bin], dos.spin_sums[bin], dos.log_g[bin] - min_log_g);
+	}
+
+	fclose(output);
+}
+
+#endif // ISING_MODEL_SIMULATION_HPP_INCLUDED
@@ -0,0 +1,507 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_SNAPSHOT_HPP_INCLUDED
+#define ISING_MODEL_SNAPSHOT_HPP_INCLUDED
+
+#include "LatticeLayout.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+//===============//
+// Stream Format //
+//===============//
+
+// A snapshot stream is a pair of files:
+//     <prefix>.snap - concatenated zlib blobs, one per frame
+//     <prefix>.idx  - SnapshotIndexHeader followed by one SnapshotIndexEntry per frame
+// The index has fixed-size records, so it can be mmap()-ed for random access.
+//
+// A frame is the lattice bit-packed in canonical (x, y, z, w) row-major order,
+// least significant bit first, bit set for spin +1. Vacancies (site dilution) are
+// stored as clear bits, same as spin -1: the vacancy mask is fixed for a sample and
+// is regenerated from disorder_seed, not stored. Delta frames store the XOR
+// against the previous frame of the same sample, which is mostly zero bytes
+// and compresses far better than the spins themselves.
+
+const char SNAPSHOT_INDEX_MAGIC[8] = {'I', 'S', 'N', 'A', 'P', 'I', 'D', 'X'};
+const uint32_t SNAPSHOT_FORMAT_VERSION = 1;
+
+const uint32_t SNAPSHOT_FLAG_KEYFRAME = 1;
+const uint64_t SNAPSHOT_NO_ENTRY = ~static_cast<uint64_t>(0);
+
+struct SnapshotIndexHeader
+{
+	char     magic[8];
+	uint32_t version;
+	int32_t  sizes[LATTICE_MAX_DIMS];
+	uint32_t num_sites;
+	uint32_t packed_bytes;
+	uint32_t reserved;
+};
+
+struct SnapshotIndexEntry
+{
+	uint64_t data_offset;
+	uint32_t compressed_bytes;
+	uint32_t flags;
+
+	// Position in the scan:
+	uint32_t sample;
+	uint32_t frame;
+	uint64_t step;
+	float temperature;
+	float field;
+
+	// Index entry of the frame this delta is taken against:
+	uint64_t previous_entry;
+};
+
+size_t snapshot_packed_bytes(unsigned num_sites)
+{
+	return (num_sites + 7) / 8;
+}
+
+//===================//
+// Background Writer //
+//===================//
+
+class SnapshotWriter
+{
+private:
+	struct PendingFrame
+	{
+		uint32_t sample;
+		uint32_t frame;
+		uint64_t step;
+		float temperature;
+		float field;
+		bool last_of_sample;
+		std::vector<uint8_t> packed;
+	};
+
+	// Output:
+	FILE* data_file;
+	FILE* index_file;
+	uint64_t data_offset;
+	uint64_t num_entries;
+
+	// Encoding parameters:
+	size_t packed_bytes;
+	unsigned keyframe_interval;
+	bool use_delta;
+
+	// Producer-consumer queue:
+	pthread_mutex_t queue_mutex;
+	pthread_cond_t  queue_not_empty;
+	pthread_cond_t  queue_not_full;
+	std::deque<PendingFrame> queue;
+	size_t max_queue_length;
+	bool finishing;
+
+	pthread_t io_thread;
+
+	// I/O thread state, previous frame and its index entry per sample:
+	struct SampleState
+	{
+		std::vector<uint8_t> previous;
+		uint64_t previous_entry;
+	};
+	std::unordered_map<uint32_t, SampleState> samples;
+
+	static void* io_thread_main(void* arg);
+	void write_frame(PendingFrame& pending, std::vector<uint8_t>& delta, std::vector<uint8_t>& compressed);
+
+public:
+	SnapshotWriter(const char* prefix, const int sizes[LATTICE_MAX_DIMS],
+	               unsigned keyframe_interval, bool use_delta, size_t max_queue_length = 64);
+	~SnapshotWriter();
+
+	size_t get_packed_bytes() const;
+
+	// Copies the packed frame into the queue. Blocks while the queue is full.
+	void submit(uint32_t sample, uint32_t frame, uint64_t step, float temperature, float field,
+	            const uint8_t* packed, bool last_of_sample);
+};
+
+SnapshotWriter::SnapshotWriter(const char* prefix, const int sizes[LATTICE_MAX_DIMS],
+                               unsigned keyframe_intvl, bool delta, size_t max_queue_len) :
+	data_file         (nullptr),
+	index_file        (nullptr),
+	data_offset       (0),
+	num_entries       (0),
+	packed_bytes      (0),
+	keyframe_interval (keyframe_intvl == 0? 1 : keyframe_intvl),
+	use_delta         (delta),
+	queue             (),
+	max_queue_length  (max_queue_len == 0? 1 : max_queue_len),
+	finishing         (false),
+	samples           ()
+{
+	unsigned num_sites = 1;
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis) num_sites *= sizes[axis];
+	packed_bytes = snapshot_packed_bytes(num_sites);
+
+	// Open both files:
+	std::string data_filename  = std::string(prefix) + ".snap";
+	std::string index_filename = std::string(prefix) + ".idx";
+
+	data_file  = fopen( data_filename.c_str(), "wb");
+	index_file = fopen(index_filename.c_str(), "wb");
+	if (data_file == nullptr || index_file == nullptr)
+	{
+		if (data_file  != nullptr) fclose(data_file);
+		if (index_file != nullptr) fclose(index_file);
+		throw std::runtime_error("SnapshotWriter::SnapshotWriter(): Unable to open snapshot files");
+	}
+
+	SnapshotIndexHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_INDEX_MAGIC, sizeof(header.magic));
+	header.version      = SNAPSHOT_FORMAT_VERSION;
+	header.num_sites    = num_sites;
+	header.packed_bytes = packed_bytes;
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis) header.sizes[axis] = sizes[axis];
+
+	if (fwrite(&header, sizeof(header), 1, index_file) != 1)
+	{
+		fclose(data_file);
+		fclose(index_file);
+		throw std::runtime_error("SnapshotWriter::SnapshotWriter(): Unable to write index header");
+	}
+
+	// Start the I/O thread:
+	pthread_mutex_init(&queue_mutex, nullptr);
+	pthread_cond_init (&queue_not_empty, nullptr);
+	pthread_cond_init (&queue_not_full,  nullptr);
+
+	if (pthread_create(&io_thread, nullptr, io_thread_main, this) != 0)
+	{
+		fclose(data_file);
+		fclose(index_file);
+		throw std::runtime_error("SnapshotWriter::SnapshotWriter(): Unable to create I/O thread");
+	}
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+	// Drain the queue and stop the I/O thread:
+	pthread_mutex_lock(&queue_mutex);
+	finishing = true;
+	pthread_cond_signal(&queue_not_empty);
+	pthread_mutex_unlock(&queue_mutex);
+
+	pthread_join(io_thread, nullptr);
+
+	pthread_mutex_destroy(&queue_mutex);
+	pthread_cond_destroy (&queue_not_empty);
+	pthread_cond_destroy (&queue_not_full);
+
+	fclose(data_file);
+	fclose(index_file);
+}
+
+size_t SnapshotWriter::get_packed_bytes() const
+{
+	return packed_bytes;
+}
+
+void SnapshotWriter::submit(uint32_t sample, uint32_t frame, uint64_t step, float temperature, float field,
+                            const uint8_t* packed, bool last_of_sample)
+{
+	PendingFrame pending;
+	pending.sample         = sample;
+	pending.frame          = frame;
+	pending.step           = step;
+	pending.temperature    = temperature;
+	pending.field          = field;
+	pending.last_of_sample = last_of_sample;
+	pending.packed.assign(packed, packed + packed_bytes);
+
+	pthread_mutex_lock(&queue_mutex);
+
+	while (queue.size() >= max_queue_length)
+	{
+		pthread_cond_wait(&queue_not_full, &queue_mutex);
+	}
+
+	queue.push_back(std::move(pending));
+	pthread_cond_signal(&queue_not_empty);
+
+	pthread_mutex_unlock(&queue_mutex);
+}
+
+void* SnapshotWriter::io_thread_main(void* arg)
+{
+	SnapshotWriter* writer = reinterpret_cast<SnapshotWriter*>(arg);
+
+	std::vector<uint8_t> delta(writer->packed_bytes);
+	std::vector<uint8_t> compressed(compressBound(writer->packed_bytes));
+
+	while (true)
+	{
+		pthread_mutex_lock(&writer->queue_mutex);
+
+		while (writer->queue.empty() && !writer->finishing)
+		{
+			pthread_cond_wait(&writer->queue_not_empty, &writer->queue_mutex);
+		}
+
+		if (writer->queue.empty())
+		{
+			pthread_mutex_unlock(&writer->queue_mutex);
+			break;
+		}
+
+		PendingFrame pending = std::move(writer->queue.front());
+		writer->queue.pop_front();
+
+		pthread_cond_signal(&writer->queue_not_full);
+		pthread_mutex_unlock(&writer->queue_mutex);
+
+		writer->write_frame(pending, delta, compressed);
+	}
+
+	fflush(writer->data_file);
+	fflush(writer->index_file);
+
+	return nullptr;
+}
+
+void SnapshotWriter::write_frame(PendingFrame& pending, std::vector<uint8_t>& delta, std::vector<uint8_t>& compressed)
+{
+	SampleState& state = samples[pending.sample];
+
+	bool keyframe = !use_delta || state.previous.empty() || pending.frame % keyframe_interval == 0;
+
+	const uint8_t* payload = pending.packed.data();
+	if (!keyframe)
+	{
+		for (size_t byte = 0; byte < packed_bytes; ++byte)
+		{
+			delta[byte] = pending.packed[byte] ^ state.previous[byte];
+		}
+
+		payload = delta.data();
+	}
+
+	uLongf compressed_bytes = compressed.size();
+	if (compress2(compressed.data(), &compressed_bytes, payload, packed_bytes, Z_BEST_SPEED) != Z_OK)
+	{
+		fprintf(stderr, "[SNAPSHOT] Unable to compress frame!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fwrite(compressed.data(), 1, compressed_bytes, data_file) != compressed_bytes)
+	{
+		fprintf(stderr, "[SNAPSHOT] Unable to write frame data!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	SnapshotIndexEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	entry.data_offset      = data_offset;
+	entry.compressed_bytes = compressed_bytes;
+	entry.flags            = keyframe? SNAPSHOT_FLAG_KEYFRAME : 0;
+	entry.sample           = pending.sample;
+	entry.frame            = pending.frame;
+	entry.step             = pending.step;
+	entry.temperature      = pending.temperature;
+	entry.field            = pending.field;
+	entry.previous_entry   = keyframe? SNAPSHOT_NO_ENTRY : state.previous_entry;
+
+	if (fwrite(&entry, sizeof(entry), 1, index_file) != 1)
+	{
+		fprintf(stderr, "[SNAPSHOT] Unable to write index entry!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	data_offset += compressed_bytes;
+
+	// Keep the frame for the next delta of this sample:
+	if (pending.last_of_sample)
+	{
+		samples.erase(pending.sample);
+	}
+	else
+	{
+		state.previous.swap(pending.packed);
+		state.previous_entry = num_entries;
+	}
+
+	num_entries += 1;
+}
+
+//===============//
+// Random Access //
+//===============//
+
+class SnapshotReader
+{
+private:
+	int data_fd;
+	int index_fd;
+
+	const SnapshotIndexHeader* header;
+	const SnapshotIndexEntry*  entries;
+	size_t index_bytes;
+	uint64_t num_entries;
+
+	void read_payload(uint64_t entry, std::vector<uint8_t>& compressed, uint8_t* payload) const;
+
+public:
+	explicit SnapshotReader(const char* prefix);
+	~SnapshotReader();
+
+	uint64_t num_frames() const;
+	const SnapshotIndexHeader& get_header() const;
+	const SnapshotIndexEntry&  get_entry(uint64_t entry) const;
+
+	// Decodes a frame into header.packed_bytes bytes of packed spins.
+	// Delta frames are resolved by replaying the chain from its keyframe.
+	void read_packed(uint64_t entry, uint8_t* packed) const;
+
+	// Decodes a frame into header.num_sites spins of +1/-1:
+	void read_spins(uint64_t entry, int8_t* spins) const;
+};
+
+SnapshotReader::SnapshotReader(const char* prefix) :
+	data_fd     (-1),
+	index_fd    (-1),
+	header      (nullptr),
+	entries     (nullptr),
+	index_bytes (0),
+	num_entries (0)
+{
+	std::string data_filename  = std::string(prefix) + ".snap";
+	std::string index_filename = std::string(prefix) + ".idx";
+
+	data_fd  = open( data_filename.c_str(), O_RDONLY);
+	index_fd = open(index_filename.c_str(), O_RDONLY);
+
+	struct stat index_stat;
+	if (data_fd == -1 || index_fd == -1 || fstat(index_fd, &index_stat) == -1 ||
+	    static_cast<size_t>(index_stat.st_size) < sizeof(SnapshotIndexHeader))
+	{
+		if (data_fd  != -1) close(data_fd);
+		if (index_fd != -1) close(index_fd);
+		throw std::runtime_error("SnapshotReader::SnapshotReader(): Unable to open snapshot files");
+	}
+
+	index_bytes = index_stat.st_size;
+
+	void* mapping = mmap(nullptr, index_bytes, PROT_READ, MAP_SHARED, index_fd, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close(data_fd);
+		close(index_fd);
+		throw std::runtime_error("SnapshotReader::SnapshotReader(): Unable to map snapshot index");
+	}
+
+	header  = reinterpret_cast<const SnapshotIndexHeader*>(mapping);
+	entries = reinterpret_cast<const SnapshotIndexEntry*>(header + 1);
+	num_entries = (index_bytes - sizeof(SnapshotIndexHeader)) / sizeof(SnapshotIndexEntry);
+
+	if (memcmp(header->magic, SNAPSHOT_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != SNAPSHOT_FORMAT_VERSION)
+	{
+		munmap(mapping, index_bytes);
+		close(data_fd);
+		close(index_fd);
+		throw std::runtime_error("SnapshotReader::SnapshotReader(): Not a snapshot index");
+	}
+}
+
+SnapshotReader::~SnapshotReader()
+{
+	munmap(const_cast<SnapshotIndexHeader*>(header), index_bytes);
+	close(data_fd);
+	close(index_fd);
+}
+
+uint64_t SnapshotReader::num_frames() const
+{
+	return num_entries;
+}
+
+const SnapshotIndexHeader& SnapshotReader::get_header() const
+{
+	return *header;
+}
+
+const SnapshotIndexEntry& SnapshotReader::get_entry(uint64_t entry) const
+{
+	if (entry >= num_entries)
+	{
+		throw std::out_of_range("SnapshotReader::get_entry(): No such frame");
+	}
+
+	return entries[entry];
+}
+
+void SnapshotReader::read_payload(uint64_t entry, std::vector<uint8_t>& compressed, uint8_t* payload) const
+{
+	const SnapshotIndexEntry& record = get_entry(entry);
+
+	compressed.resize(record.compressed_bytes);
+	if (pread(data_fd, compressed.data(), record.compressed_bytes, record.data_offset) !=
+	    static_cast<ssize_t>(record.compressed_bytes))
+	{
+		throw std::runtime_error("SnapshotReader::read_payload(): Unable to read frame data");
+	}
+
+	uLongf payload_bytes = header->packed_bytes;
+	if (uncompress(payload, &payload_bytes, compressed.data(), record.compressed_bytes) != Z_OK ||
+	    payload_bytes != header->packed_bytes)
+	{
+		throw std::runtime_error("SnapshotReader::read_payload(): Corrupted frame data");
+	}
+}
+
+void SnapshotReader::read_packed(uint64_t entry, uint8_t* packed) const
+{
+	// Walk back to the keyframe:
+	std::vector<uint64_t> chain;
+	for (uint64_t cur = entry; ; cur = get_entry(cur).previous_entry)
+	{
+		chain.push_back(cur);
+		if (get_entry(cur).flags & SNAPSHOT_FLAG_KEYFRAME) break;
+	}
+
+	// Replay deltas forward:
+	std::vector<uint8_t> compressed;
+	std::vector<uint8_t> delta(header->packed_bytes);
+
+	read_payload(chain.back(), compressed, packed);
+	for (size_t link = chain.size() - 1; link-- > 0;)
+	{
+		read_payload(chain[link], compressed, delta.data());
+		for (size_t byte = 0; byte < header->packed_bytes; ++byte) packed[byte] ^= delta[byte];
+	}
+}
+
+void SnapshotReader::read_spins(uint64_t entry, int8_t* spins) const
+{
+	std::vector<uint8_t> packed(header->packed_bytes);
+	read_packed(entry, packed.data());
+
+	for (uint32_t site = 0; site < header->num_sites; ++site)
+	{
+		spins[site] = (packed[site / 8] >> (site % 8)) & 1? 1 : -1;
+	}
+}
+
+#endif // ISING_MODEL_SNAPSHOT_HPP_INCLUDED
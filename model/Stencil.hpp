@@ -0,0 +1,323 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_STENCIL_HPP_INCLUDED
+#define ISING_MODEL_STENCIL_HPP_INCLUDED
+
+#include "LatticeLayout.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+//====================//
+// Lattice Geometries //
+//====================//
+
+// Every geometry is embedded into a periodic hyper-rectangular grid of up to
+// four axes, with nearest neighbours given by constant coordinate offsets.
+// All offsets lie in [-1, +1], which is exactly the halo of the layout tables.
+//
+// BCC and FCC are stored in reduced (primitive cell) coordinates, the way the
+// triangular lattice is a square grid plus a diagonal: every grid point is a
+// site, and the periodic box is a rhombohedral supercell of the lattice.
+
+enum Geometry
+{
+	GEOMETRY_SQUARE        = 0,
+	GEOMETRY_TRIANGULAR    = 1,
+	GEOMETRY_SIMPLE_CUBIC  = 2,
+	GEOMETRY_BCC           = 3,
+	GEOMETRY_FCC           = 4,
+	GEOMETRY_HYPERCUBIC_4D = 5
+};
+
+// Largest coordination number among the geometries (FCC):
+const int STENCIL_MAX_NEIGHBOURS = 12;
+
+struct SquareStencil
+{
+	static constexpr int DIMENSIONS = 2;
+	static constexpr int NEIGHBOURS = 4;
+	static constexpr int OFFSETS[NEIGHBOURS][LATTICE_MAX_DIMS] =
+	{
+		{-1,  0, 0, 0}, {+1,  0, 0, 0},
+		{ 0, -1, 0, 0}, { 0, +1, 0, 0}
+	};
+};
+
+// Square grid plus one diagonal:
+struct TriangularStencil
+{
+	static constexpr int DIMENSIONS = 2;
+	static constexpr int NEIGHBOURS = 6;
+	static constexpr int OFFSETS[NEIGHBOURS][LATTICE_MAX_DIMS] =
+	{
+		{-1,  0, 0, 0}, {+1,  0, 0, 0},
+		{ 0, -1, 0, 0}, { 0, +1, 0, 0},
+		{+1, -1, 0, 0}, {-1, +1, 0, 0}
+	};
+};
+
+struct SimpleCubicStencil
+{
+	static constexpr int DIMENSIONS = 3;
+	static constexpr int NEIGHBOURS = 6;
+	static constexpr int OFFSETS[NEIGHBOURS][LATTICE_MAX_DIMS] =
+	{
+		{-1,  0,  0, 0}, {+1,  0,  0, 0},
+		{ 0, -1,  0, 0}, { 0, +1,  0, 0},
+		{ 0,  0, -1, 0}, { 0,  0, +1, 0}
+	};
+};
+
+// Primitive vectors (-1, 1, 1), (1, -1, 1), (1, 1, -1) in half cube edges:
+// the eight (+-1, +-1, +-1) neighbours are +-a1, +-a2, +-a3 and +-(a1 + a2 + a3).
+struct BodyCenteredCubicStencil
+{
+	static constexpr int DIMENSIONS = 3;
+	static constexpr int NEIGHBOURS = 8;
+	static constexpr int OFFSETS[NEIGHBOURS][LATTICE_MAX_DIMS] =
+	{
+		{-1,  0,  0, 0}, {+1,  0,  0, 0},
+		{ 0, -1,  0, 0}, { 0, +1,  0, 0},
+		{ 0,  0, -1, 0}, { 0,  0, +1, 0},
+		{-1, -1, -1, 0}, {+1, +1, +1, 0}
+	};
+};
+
+// Primitive vectors (0, 1, 1), (1, 0, 1), (1, 1, 0) in half cube edges:
+// the twelve (+-1, +-1, 0) neighbours are +-a_i and +-(a_i - a_j).
+struct FaceCenteredCubicStencil
+{
+	static constexpr int DIMENSIONS = 3;
+	static constexpr int NEIGHBOURS = 12;
+	static constexpr int OFFSETS[NEIGHBOURS][LATTICE_MAX_DIMS] =
+	{
+		{-1,  0,  0, 0}, {+1,  0,  0, 0},
+		{ 0, -1,  0, 0}, { 0, +1,  0, 0},
+		{ 0,  0, -1, 0}, { 0,  0, +1, 0},
+		{+1, -1,  0, 0}, {-1, +1,  0, 0},
+		{+1,  0, -1, 0}, {-1,  0, +1, 0},
+		{ 0, +1, -1, 0}, { 0, -1, +1, 0}
+	};
+};
+
+struct Hypercubic4DStencil
+{
+	static constexpr int DIMENSIONS = 4;
+	static constexpr int NEIGHBOURS = 8;
+	static constexpr int OFFSETS[NEIGHBOURS][LATTICE_MAX_DIMS] =
+	{
+		{-1,  0,  0,  0}, {+1,  0,  0,  0},
+		{ 0, -1,  0,  0}, { 0, +1,  0,  0},
+		{ 0,  0, -1,  0}, { 0,  0, +1,  0},
+		{ 0,  0,  0, -1}, { 0,  0,  0, +1}
+	};
+};
+
+constexpr int SquareStencil           ::OFFSETS[SquareStencil           ::NEIGHBOURS][LATTICE_MAX_DIMS];
+constexpr int TriangularStencil       ::OFFSETS[TriangularStencil       ::NEIGHBOURS][LATTICE_MAX_DIMS];
+constexpr int SimpleCubicStencil      ::OFFSETS[SimpleCubicStencil      ::NEIGHBOURS][LATTICE_MAX_DIMS];
+constexpr int BodyCenteredCubicStencil::OFFSETS[BodyCenteredCubicStencil::NEIGHBOURS][LATTICE_MAX_DIMS];
+constexpr int FaceCenteredCubicStencil::OFFSETS[FaceCenteredCubicStencil::NEIGHBOURS][LATTICE_MAX_DIMS];
+constexpr int Hypercubic4DStencil     ::OFFSETS[Hypercubic4DStencil     ::NEIGHBOURS][LATTICE_MAX_DIMS];
+
+//=========================//
+// Unrolled Stencil Access //
+//=========================//
+
+// The unrolled sums must collapse into the sweep loop whatever the inliner's budget:
+#define STENCIL_INLINE inline __attribute__((always_inline))
+
+// Storage index of neighbour N of the site at coords.
+// Offsets are compile-time constants, so every lookup is four table loads at most:
+template <typename Stencil, int N>
+STENCIL_INLINE int stencil_neighbour_index(const LayoutTables& tables, const int coords[LATTICE_MAX_DIMS])
+{
+	return tables.offsets[0][coords[0] + 1 + Stencil::OFFSETS[N][0]] +
+	       tables.offsets[1][coords[1] + 1 + Stencil::OFFSETS[N][1]] +
+	       tables.offsets[2][coords[2] + 1 + Stencil::OFFSETS[N][2]] +
+	       tables.offsets[3][coords[3] + 1 + Stencil::OFFSETS[N][3]];
+}
+
+// Sum of the spins of neighbours [0, N), unrolled by template recursion:
+template <typename Stencil, int N>
+struct StencilSum
+{
+	static STENCIL_INLINE int sum(const char* points, const LayoutTables& tables, const int coords[LATTICE_MAX_DIMS])
+	{
+		return StencilSum<Stencil, N - 1>::sum(points, tables, coords) +
+		       points[stencil_neighbour_index<Stencil, N - 1>(tables, coords)];
+	}
+};
+
+template <typename Stencil>
+struct StencilSum<Stencil, 0>
+{
+	static STENCIL_INLINE int sum(const char*, const LayoutTables&, const int*)
+	{
+		return 0;
+	}
+};
+
+//====================//
+// Geometry Selection //
+//====================//
+
+const char* geometry_name(Geometry geometry)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return "square";
+		case GEOMETRY_TRIANGULAR:    return "triangular";
+		case GEOMETRY_SIMPLE_CUBIC:  return "simple_cubic";
+		case GEOMETRY_BCC:           return "bcc";
+		case GEOMETRY_FCC:           return "fcc";
+		case GEOMETRY_HYPERCUBIC_4D: return "hypercubic_4d";
+	}
+
+	return "unknown";
+}
+
+bool parse_geometry(const char* name, Geometry* geometry)
+{
+	if (name == nullptr || geometry == nullptr) return false;
+
+	if (strcmp(name, "square"       ) == 0) { *geometry = GEOMETRY_SQUARE;        return true; }
+	if (strcmp(name, "triangular"   ) == 0) { *geometry = GEOMETRY_TRIANGULAR;    return true; }
+	if (strcmp(name, "simple_cubic" ) == 0) { *geometry = GEOMETRY_SIMPLE_CUBIC;  return true; }
+	if (strcmp(name, "bcc"          ) == 0) { *geometry = GEOMETRY_BCC;           return true; }
+	if (strcmp(name, "fcc"          ) == 0) { *geometry = GEOMETRY_FCC;           return true; }
+	if (strcmp(name, "hypercubic_4d") == 0) { *geometry = GEOMETRY_HYPERCUBIC_4D; return true; }
+
+	return false;
+}
+
+int geometry_dimensions(Geometry geometry)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return SquareStencil           ::DIMENSIONS;
+		case GEOMETRY_TRIANGULAR:    return TriangularStencil       ::DIMENSIONS;
+		case GEOMETRY_SIMPLE_CUBIC:  return SimpleCubicStencil      ::DIMENSIONS;
+		case GEOMETRY_BCC:           return BodyCenteredCubicStencil::DIMENSIONS;
+		case GEOMETRY_FCC:           return FaceCenteredCubicStencil::DIMENSIONS;
+		case GEOMETRY_HYPERCUBIC_4D: return Hypercubic4DStencil     ::DIMENSIONS;
+	}
+
+	return 0;
+}
+
+int geometry_neighbours(Geometry geometry)
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return SquareStencil           ::NEIGHBOURS;
+		case GEOMETRY_TRIANGULAR:    return TriangularStencil       ::NEIGHBOURS;
+		case GEOMETRY_SIMPLE_CUBIC:  return SimpleCubicStencil      ::NEIGHBOURS;
+		case GEOMETRY_BCC:           return BodyCenteredCubicStencil::NEIGHBOURS;
+		case GEOMETRY_FCC:           return FaceCenteredCubicStencil::NEIGHBOURS;
+		case GEOMETRY_HYPERCUBIC_4D: return Hypercubic4DStencil     ::NEIGHBOURS;
+	}
+
+	return 0;
+}
+
+//==================//
+// Helical Boundary //
+//==================//
+
+// Periodic boundaries wrap every axis on its own. Helical (screw-periodic) boundaries
+// wrap the row-major chain of sites as a whole: neighbour N of linear site i is
+//     i + delta[N] (mod volume),  delta[N] = dot(OFFSETS[N], row-major strides)
+// Sites that stepped over an edge land on the next row, which is a negligible change
+// of the physics for large lattices.
+enum Boundary
+{
+	BOUNDARY_PERIODIC = 0,
+	BOUNDARY_HELICAL  = 1
+};
+
+const char* boundary_name(Boundary boundary)
+{
+	switch (boundary)
+	{
+		case BOUNDARY_PERIODIC: return "periodic";
+		case BOUNDARY_HELICAL:  return "helical";
+	}
+
+	return "unknown";
+}
+
+bool parse_boundary(const char* name, Boundary* boundary)
+{
+	if (name == nullptr || boundary == nullptr) return false;
+
+	if (strcmp(name, "periodic") == 0) { *boundary = BOUNDARY_PERIODIC; return true; }
+	if (strcmp(name, "helical" ) == 0) { *boundary = BOUNDARY_HELICAL;  return true; }
+
+	return false;
+}
+
+// Fills the linear neighbour offsets and returns the largest of their magnitudes:
+template <typename Stencil>
+int stencil_helical_deltas(const int sizes[LATTICE_MAX_DIMS], int deltas[STENCIL_MAX_NEIGHBOURS])
+{
+	int strides[LATTICE_MAX_DIMS];
+	int stride = 1;
+	for (int axis = LATTICE_MAX_DIMS - 1; axis >= 0; --axis)
+	{
+		strides[axis] = stride;
+		stride *= sizes[axis];
+	}
+
+	int reach = 0;
+	for (int neighbour = 0; neighbour < Stencil::NEIGHBOURS; ++neighbour)
+	{
+		deltas[neighbour] = 0;
+		for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+		{
+			deltas[neighbour] += Stencil::OFFSETS[neighbour][axis] * strides[axis];
+		}
+
+		reach = std::max(reach, std::abs(deltas[neighbour]));
+	}
+
+	return reach;
+}
+
+int geometry_helical_deltas(Geometry geometry, const int sizes[LATTICE_MAX_DIMS], int deltas[STENCIL_MAX_NEIGHBOURS])
+{
+	switch (geometry)
+	{
+		case GEOMETRY_SQUARE:        return stencil_helical_deltas<SquareStencil           >(sizes, deltas);
+		case GEOMETRY_TRIANGULAR:    return stencil_helical_deltas<TriangularStencil       >(sizes, deltas);
+		case GEOMETRY_SIMPLE_CUBIC:  return stencil_helical_deltas<SimpleCubicStencil      >(sizes, deltas);
+		case GEOMETRY_BCC:           return stencil_helical_deltas<BodyCenteredCubicStencil>(sizes, deltas);
+		case GEOMETRY_FCC:           return stencil_helical_deltas<FaceCenteredCubicStencil>(sizes, deltas);
+		case GEOMETRY_HYPERCUBIC_4D: return stencil_helical_deltas<Hypercubic4DStencil     >(sizes, deltas);
+	}
+
+	return 0;
+}
+
+// Sum of neighbours [0, N) of the site at *site. Storage must be padded by the
+// stencil reach on both ends, so the wrap costs neither a modulo nor a branch:
+template <typename Stencil, int N>
+struct HelicalSum
+{
+	static STENCIL_INLINE int sum(const char* site, const int* deltas)
+	{
+		return HelicalSum<Stencil, N - 1>::sum(site, deltas) + site[deltas[N - 1]];
+	}
+};
+
+template <typename Stencil>
+struct HelicalSum<Stencil, 0>
+{
+	static STENCIL_INLINE int sum(const char*, const int*)
+	{
+		return 0;
+	}
+};
+
+#endif // ISING_MODEL_STENCIL_HPP_INCLUDED
@@ -16,6 +16,9 @@
 #include <pthread.h>
 // Processor heating:
 #include <cmath>
+// Frequency and thermal sensors:
+#include <glob.h>
+#include <time.h>
 
 //===============================//
 // Cache Line Sharing Prevention //
@@ -37,87 +40,94 @@ struct CpuInfo
 	int assigned_harts; 
 };
 
-CpuInfo online_hardware_threads()
+// Reports failures instead of exiting: returns false and points error at the message.
+bool try_online_hardware_threads(CpuInfo* cpu_info, const char** error)
 {
 	// Open list of online harts file:
 	int online_harts_fd = open("/sys/devices/system/cpu/online", O_RDONLY);
 	if (online_harts_fd == -1)
 	{
-		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Acquire CPU topology: openat(\"online\") failed!\n");
-		exit(EXIT_FAILURE);
+		*error = "openat(\"online\") failed";
+		return false;
 	}
 
 	// Fill in the buffer
 	char online_hart_buf[256];
 	int online_harts_buf_len = read(online_harts_fd, online_hart_buf, 256);
+	close(online_harts_fd);
+
 	if (online_harts_buf_len == -1)
 	{
-		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Acquire CPU topology: read failed!\n");
-		exit(EXIT_FAILURE);
+		*error = "read failed";
+		return false;
 	}
 	if (online_harts_buf_len == 256)
 	{
-		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Acquire CPU topology: not enough buffer space for online harts!\n");
-		exit(EXIT_FAILURE);
+		*error = "not enough buffer space for online harts";
+		return false;
 	}
 
-	// Create CpuInfo:
-	CpuInfo cpu_info;
+	// Fill in CpuInfo:
+	CPU_ZERO(&cpu_info->online_harts);
+	cpu_info->hart_arr_size = 0;
 
-	CPU_ZERO(&cpu_info.online_harts);
-	cpu_info.hart_arr_size = 0;
+	cpu_info->current_hart = 0;
+	cpu_info->assigned_harts = 0;
 
-	cpu_info.current_hart = 0;
-	cpu_info.assigned_harts = 0;
+	// Parse list of online processors ("0-3,5,7-8\n"):
+	online_hart_buf[online_harts_buf_len] = '\0';
 
-	// Parse list of online processors
-	for (char* cur_char = online_hart_buf;
-		 cur_char < online_hart_buf + online_harts_buf_len && *cur_char != 0;
-		 ++cur_char)
+	char* cur_char = online_hart_buf;
+	while (*cur_char != '\0' && *cur_char != '\n')
 	{
 		// Parse active hart id:
 		char* end_ptr = cur_char;
 		int hart_id_1 = strtol(cur_char, &end_ptr, 10);
 		if (cur_char == end_ptr || hart_id_1 < 0)
 		{
-			fprintf(stderr, "[THREAD-CORE-SCALABILITY] Acquire CPU topology: unable to parse cpu id!\n");
-			exit(EXIT_FAILURE);
+			*error = "unable to parse cpu id";
+			return false;
 		}
 
 		cur_char = end_ptr;
 
+		int hart_id_2 = hart_id_1;
 		if (*cur_char == '-')
 		{
 			cur_char += 1;
 
-			int hart_id_2 = strtol(cur_char, &end_ptr, 10);
-			if (end_ptr == cur_char || hart_id_2 < 0)
+			hart_id_2 = strtol(cur_char, &end_ptr, 10);
+			if (end_ptr == cur_char || hart_id_2 < hart_id_1)
 			{
-				fprintf(stderr, "[THREAD-CORE-SCALABILITY] Acquire CPU topology: unable to parse cpu id!\n");
-				exit(EXIT_FAILURE);
+				*error = "unable to parse cpu id";
+				return false;
 			}
 
 			cur_char = end_ptr;
-
-			for (int hart = hart_id_1; hart <= hart_id_2; ++hart)
-			{
-				CPU_SET(hart, &cpu_info.online_harts);
-			}
-
-			cpu_info.hart_arr_size = hart_id_2 + 1;
 		}
-		else if (*cur_char == ',' || *cur_char == '\0')
+
+		for (int hart = hart_id_1; hart <= hart_id_2; ++hart)
 		{
-			cur_char += 1;
+			CPU_SET(hart, &cpu_info->online_harts);
+		}
 
-			CPU_SET(hart_id_1, &cpu_info.online_harts);
+		cpu_info->hart_arr_size = hart_id_2 + 1;
 
-			cpu_info.hart_arr_size = hart_id_1 + 1;
-		}
+		if (*cur_char == ',') cur_char += 1;
 	}
 
-	// Close both files:
-	close(online_harts_fd);
+	return true;
+}
+
+CpuInfo online_hardware_threads()
+{
+	CpuInfo cpu_info;
+	const char* error = nullptr;
+	if (!try_online_hardware_threads(&cpu_info, &error))
+	{
+		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Acquire CPU topology: %s!\n", error);
+		exit(EXIT_FAILURE);
+	}
 
 	return cpu_info;
 }
@@ -154,37 +164,204 @@ cpu_set_t assign_hardware_thread(CpuInfo* cpu_info)
 	return assigned_hart;
 }
 
-void create_anchored_thread(pthread_t* thread, void* (*computation)(void*), void* arg,
-                            const cpu_set_t* harts_to_run_on)
+// Reports failures instead of exiting: returns false and points error at the message.
+bool try_create_anchored_thread(pthread_t* thread, void* (*computation)(void*), void* arg,
+                                const cpu_set_t* harts_to_run_on, const char** error)
 {
 	// Check arguments:
 	if (thread == nullptr || computation == nullptr || harts_to_run_on == nullptr)
 	{
-		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Invalid arguments!\n");
-		exit(EXIT_FAILURE);
+		*error = "Invalid arguments";
+		return false;
 	}
 
 	// Anchor thread to a hardware thread:
 	pthread_attr_t thread_attributes;
 	if (pthread_attr_init(&thread_attributes) != 0)
 	{
-		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Unable to call pthread_attr_init!\n");
-		exit(EXIT_FAILURE);
+		*error = "Unable to call pthread_attr_init";
+		return false;
 	}
 
 	if (pthread_attr_setaffinity_np(&thread_attributes, sizeof(cpu_set_t), harts_to_run_on) != 0)
 	{
-		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Unable to call pthread_attr_setaffinity_np!\n");
-		exit(EXIT_FAILURE);
+		pthread_attr_destroy(&thread_attributes);
+
+		*error = "Unable to call pthread_attr_setaffinity_np";
+		return false;
 	}
 
 	// Create thread:
 	int pthread_created = pthread_create(thread, &thread_attributes, computation, arg);
+	pthread_attr_destroy(&thread_attributes);
+
 	if (pthread_created != 0)
 	{
-		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Unable to create thread!\n");
+		*error = "Unable to create thread";
+		return false;
+	}
+
+	return true;
+}
+
+void create_anchored_thread(pthread_t* thread, void* (*computation)(void*), void* arg,
+                            const cpu_set_t* harts_to_run_on)
+{
+	const char* error = nullptr;
+	if (!try_create_anchored_thread(thread, computation, arg, harts_to_run_on, &error))
+	{
+		fprintf(stderr, "[THREAD-CORE-SCALABILITY] %s!\n", error);
+		exit(EXIT_FAILURE);
+	}
+}
+
+//===========================================//
+// CPU Frequency and Thermal Sensor Sampling //
+//===========================================//
+
+struct MachineState
+{
+	// Current frequency of every online hart (0.0 if cpufreq is unavailable):
+	float hart_freq_mhz[CPU_SETSIZE];
+	unsigned freq_sensors;
+
+	// Hottest thermal zone:
+	float max_temp_celsius;
+	unsigned temp_sensors;
+};
+
+// Returns -1 on failure:
+long read_sysfs_long(const char* filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) return -1;
+
+	char buf[64];
+	int buf_len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+
+	if (buf_len <= 0) return -1;
+	buf[buf_len] = '\0';
+
+	char* end_ptr = buf;
+	long value = strtol(buf, &end_ptr, 10);
+	if (end_ptr == buf) return -1;
+
+	return value;
+}
+
+MachineState sample_machine_state(const CpuInfo* cpu_info)
+{
+	if (cpu_info == nullptr)
+	{
+		fprintf(stderr, "[THREAD-CORE-SCALABILITY] Invalid argument!");
 		exit(EXIT_FAILURE);
 	}
+
+	MachineState state;
+	state.freq_sensors = 0;
+	state.temp_sensors = 0;
+	state.max_temp_celsius = 0.0;
+
+	// Per-hart frequency (in kHz in sysfs):
+	char filename[128];
+	for (unsigned hart = 0; hart < cpu_info->hart_arr_size; ++hart)
+	{
+		state.hart_freq_mhz[hart] = 0.0;
+		if (not CPU_ISSET(hart, &cpu_info->online_harts)) continue;
+
+		snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu%u/cpufreq/scaling_cur_freq", hart);
+		long freq_khz = read_sysfs_long(filename);
+		if (freq_khz <= 0) continue;
+
+		state.hart_freq_mhz[hart] = freq_khz / 1000.0;
+		state.freq_sensors += 1;
+	}
+
+	// Thermal zones (in millidegrees Celsius in sysfs):
+	glob_t zones;
+	if (glob("/sys/class/thermal/thermal_zone*/temp", 0, nullptr, &zones) == 0)
+	{
+		for (size_t zone = 0; zone < zones.gl_pathc; ++zone)
+		{
+			long millidegrees = read_sysfs_long(zones.gl_pathv[zone]);
+			if (millidegrees <= 0) continue;
+
+			float celsius = millidegrees / 1000.0;
+			if (state.temp_sensors == 0 || celsius > state.max_temp_celsius) state.max_temp_celsius = celsius;
+			state.temp_sensors += 1;
+		}
+	}
+	globfree(&zones);
+
+	return state;
+}
+
+// Average frequency over a set of harts (0.0 if none of them report it):
+float average_frequency_mhz(const MachineState* state, const cpu_set_t* harts, unsigned hart_arr_size)
+{
+	float total = 0.0;
+	unsigned count = 0;
+	for (unsigned hart = 0; hart < hart_arr_size; ++hart)
+	{
+		if (not CPU_ISSET(hart, harts) || state->hart_freq_mhz[hart] <= 0.0) continue;
+
+		total += state->hart_freq_mhz[hart];
+		count += 1;
+	}
+
+	return count == 0? 0.0 : total / count;
+}
+
+// Blocks until the hottest thermal zone varies by less than tolerance over the window.
+// Returns false if the timeout passed first. Machines without sensors are steady by definition.
+bool wait_for_thermal_steady_state(const CpuInfo* cpu_info, float tolerance_celsius,
+                                   unsigned window_ms, unsigned timeout_ms)
+{
+	const unsigned SAMPLE_PERIOD_MS = 250;
+
+	unsigned window_samples = window_ms / SAMPLE_PERIOD_MS;
+	if (window_samples < 2) window_samples = 2;
+
+	float* window = new float[window_samples];
+	unsigned filled = 0;
+
+	bool steady = false;
+	for (unsigned waited_ms = 0; waited_ms <= timeout_ms; waited_ms += SAMPLE_PERIOD_MS)
+	{
+		MachineState state = sample_machine_state(cpu_info);
+		if (state.temp_sensors == 0)
+		{
+			steady = true;
+			break;
+		}
+
+		window[filled % window_samples] = state.max_temp_celsius;
+		filled += 1;
+
+		if (filled >= window_samples)
+		{
+			float min_temp = window[0], max_temp = window[0];
+			for (unsigned i = 1; i < window_samples; ++i)
+			{
+				if (window[i] < min_temp) min_temp = window[i];
+				if (window[i] > max_temp) max_temp = window[i];
+			}
+
+			if (max_temp - min_temp < tolerance_celsius)
+			{
+				steady = true;
+				break;
+			}
+		}
+
+		struct timespec period = {0, SAMPLE_PERIOD_MS * 1000000L};
+		nanosleep(&period, nullptr);
+	}
+
+	delete[] window;
+
+	return steady;
 }
 
 //=======================//
@@ -0,0 +1,284 @@
+// No Copyright. Vladislav Aleinik 2020
+#ifndef ISING_MODEL_WANG_LANDAU_HPP_INCLUDED
+#define ISING_MODEL_WANG_LANDAU_HPP_INCLUDED
+
+#include "Reweighting.hpp"
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+//======================//
+// Wang-Landau Sampling //
+//======================//
+
+// The walker estimates ln g(B, M) on the bond sum window [bond_min, bond_max] and the whole
+// spin sum axis. Every visit adds ln f to the current bin, and moves are accepted with
+// probability min(1, g(old) / g(new)), so the walk flattens out over the window. Once the
+// visit histogram is flat, ln f is halved and the histogram is cleared.
+//
+// Every flip changes B and M by even amounts, so (x - min) / 2 separates the values of
+// both axes even when vacancies or diluted bonds shift their parity.
+const uint64_t WANG_LANDAU_MAX_BINS = 1 << 22;
+
+struct WangLandauParams
+{
+	float bond_min_share; // Window range, in shares of the bond count (B = 0 is the infinite temperature mean).
+	float bond_max_share; // The whole [-1, 1] by default, narrower ranges only hold at low temperatures
+	float overlap;        // Share of a window shared with its neighbour
+	float flatness;       // Least visit count over the mean one
+	double final_log_f;
+	unsigned max_sweeps;  // Per walker, counted in lattice volumes
+};
+
+class WangLandauWalker
+{
+public:
+	int bond_min;
+	int bond_max;
+	int num_sites;
+	int bond_bins;
+	int spin_bins;
+
+	std::vector<double> log_g;
+	std::vector<uint32_t> histogram;
+	double log_f;
+	unsigned stage;
+
+	// Current configuration; walkers start outside of their window and descend into it first:
+	int bond_sum;
+	int spin_sum;
+	bool inside;
+
+	WangLandauWalker(int window_min, int window_max, int sites);
+
+	void start(int bonds, int spins);
+
+	double log_ratio(int bond_delta, int spin_delta) const;
+	void move(int bond_delta, int spin_delta);
+	void visit();
+
+	bool histogram_flat(double flatness) const;
+	void next_stage();
+
+	size_t bin(int bonds, int spins) const;
+	int distance(int bonds) const;
+};
+
+WangLandauWalker::WangLandauWalker(int window_min, int window_max, int sites) :
+	bond_min  (window_min),
+	bond_max  (window_max),
+	num_sites (sites),
+	bond_bins ((window_max - window_min) / 2 + 1),
+	spin_bins (sites + 1),
+	log_g     (),
+	histogram (),
+	log_f     (1.0),
+	stage     (0),
+	bond_sum  (0),
+	spin_sum  (0),
+	inside    (false)
+{
+	if (window_max < window_min || sites <= 0)
+	{
+		throw std::invalid_argument("WangLandauWalker::WangLandauWalker(): Empty window");
+	}
+
+	log_g    .assign(static_cast<size_t>(bond_bins) * spin_bins, 0.0);
+	histogram.assign(static_cast<size_t>(bond_bins) * spin_bins, 0);
+}
+
+void WangLandauWalker::start(int bonds, int spins)
+{
+	bond_sum = bonds;
+	spin_sum = spins;
+	inside   = distance(bonds) == 0;
+}
+
+inline size_t WangLandauWalker::bin(int bonds, int spins) const
+{
+	return static_cast<size_t>((bonds - bond_min) >> 1) * spin_bins + ((spins + num_sites) >> 1);
+}
+
+inline int WangLandauWalker::distance(int bonds) const
+{
+	if (bonds < bond_min) return bond_min - bonds;
+	if (bonds > bond_max) return bonds - bond_max;
+	return 0;
+}
+
+// Outside of the window every move that does not lead away from it is accepted:
+inline double WangLandauWalker::log_ratio(int bond_delta, int spin_delta) const
+{
+	int new_bonds = bond_sum + bond_delta;
+	int new_distance = distance(new_bonds);
+
+	if (!inside) return new_distance <= distance(bond_sum)? 0.0 : -INFINITY;
+	if (new_distance != 0) return -INFINITY;
+
+	return log_g[bin(bond_sum, spin_sum)] - log_g[bin(new_bonds, spin_sum + spin_delta)];
+}
+
+inline void WangLandauWalker::move(int bond_delta, int spin_delta)
+{
+	bond_sum += bond_delta;
+	spin_sum += spin_delta;
+	inside = inside || distance(bond_sum) == 0;
+}
+
+inline void WangLandauWalker::visit()
+{
+	if (!inside) return;
+
+	size_t cur_bin = bin(bond_sum, spin_sum);
+	log_g    [cur_bin] += log_f;
+	histogram[cur_bin] += 1;
+}
+
+// Flatness is judged over the bins visited so far, unreachable (B, M) pairs never count:
+bool WangLandauWalker::histogram_flat(double flatness) const
+{
+	uint64_t total   = 0;
+	uint64_t visited = 0;
+	uint32_t least   = UINT32_MAX;
+	for (size_t cur_bin = 0; cur_bin < log_g.size(); ++cur_bin)
+	{
+		if (log_g[cur_bin] == 0.0) continue;
+
+		total   += histogram[cur_bin];
+		visited += 1;
+		least    = std::min(least, histogram[cur_bin]);
+	}
+
+	if (visited == 0) return false;
+
+	return least >= flatness * total / visited;
+}
+
+void WangLandauWalker::next_stage()
+{
+	std::fill(histogram.begin(), histogram.end(), 0);
+	log_f /= 2.0;
+	stage += 1;
+}
+
+//=========================//
+// Window Layout & Merging //
+//=========================//
+
+// Splits [bond_lo, bond_hi] into num_windows windows, neighbours sharing the overlap share of a window:
+void wang_landau_windows(int bond_lo, int bond_hi, int num_windows, double overlap,
+                         std::vector<int>* window_min, std::vector<int>* window_max)
+{
+	double width = (bond_hi - bond_lo) / (num_windows - (num_windows - 1) * overlap);
+
+	window_min->clear();
+	window_max->clear();
+	for (int window = 0; window < num_windows; ++window)
+	{
+		double begin = bond_lo + window * width * (1.0 - overlap);
+
+		window_min->push_back(static_cast<int>(floor(begin)));
+		window_max->push_back(window == num_windows - 1? bond_hi : static_cast<int>(ceil(begin + width)));
+	}
+}
+
+// Windows are glued in the order of their bond sums: each one is shifted by the mean difference
+// of ln g over the bins it shares with the previous (non-empty) window, and the shared bond sums
+// are split at the middle of the overlap. Normalization is left to the reweighting.
+// The outer window edges are recorded as cuts, the caller clears those at the ends of the bond range.
+DensityOfStates merge_wang_landau_windows(const std::vector<const WangLandauWalker*>& walkers)
+{
+	std::vector<const WangLandauWalker*> filled;
+	for (const WangLandauWalker* walker : walkers)
+	{
+		bool visited = false;
+		for (double value : walker->log_g) visited = visited || value != 0.0;
+
+		if (visited) filled.push_back(walker);
+	}
+
+	if (filled.empty())
+	{
+		throw std::runtime_error("merge_wang_landau_windows(): No window has been visited");
+	}
+
+	std::sort(filled.begin(), filled.end(),
+	          [](const WangLandauWalker* a, const WangLandauWalker* b) { return a->bond_min < b->bond_min; });
+
+	int num_sites = filled[0]->num_sites;
+
+	std::vector<double> shifts(filled.size(), 0.0);
+	std::vector<int> cuts(filled.size() + 1);
+	cuts[0]             = INT32_MIN;
+	cuts[filled.size()] = INT32_MAX;
+
+	for (size_t window = 1; window < filled.size(); ++window)
+	{
+		const WangLandauWalker& prev = *filled[window - 1];
+		const WangLandauWalker& next = *filled[window];
+
+		int shared_min = std::max(prev.bond_min, next.bond_min);
+		int shared_max = std::min(prev.bond_max, next.bond_max);
+
+		// Both walkers sample the same lattice, so their sums share the parity:
+		int bond_parity = (prev.bond_sum - shared_min) & 1;
+		int spin_parity = (prev.spin_sum + num_sites ) & 1;
+
+		double difference = 0.0;
+		uint64_t shared_bins = 0;
+		for (int bonds = shared_min + bond_parity; bonds <= shared_max; bonds += 2)
+		{
+			for (int spins = spin_parity - num_sites; spins <= num_sites; spins += 2)
+			{
+				double prev_log_g = prev.log_g[prev.bin(bonds, spins)];
+				double next_log_g = next.log_g[next.bin(bonds, spins)];
+				if (prev_log_g == 0.0 || next_log_g == 0.0) continue;
+
+				difference  += prev_log_g + shifts[window - 1] - next_log_g;
+				shared_bins += 1;
+			}
+		}
+
+		if (shared_bins == 0)
+		{
+			throw std::runtime_error("merge_wang_landau_windows(): Neighbouring windows share no visited bins");
+		}
+
+		shifts[window] = difference / shared_bins;
+		cuts  [window] = shared_min + (shared_max - shared_min) / 2;
+	}
+
+	DensityOfStates dos;
+	dos.cut_min = filled.front()->bond_min;
+	dos.cut_max = filled.front()->bond_max;
+	for (const WangLandauWalker* walker : filled) dos.cut_max = std::max(dos.cut_max, walker->bond_max);
+
+	for (size_t window = 0; window < filled.size(); ++window)
+	{
+		const WangLandauWalker& walker = *filled[window];
+		for (int bond_bin = 0; bond_bin < walker.bond_bins; ++bond_bin)
+		{
+			for (int spin_bin = 0; spin_bin < walker.spin_bins; ++spin_bin)
+			{
+				double value = walker.log_g[static_cast<size_t>(bond_bin) * walker.spin_bins + spin_bin];
+				if (value == 0.0) continue;
+
+				// Bins are only ever filled with the parity of the visited sums:
+				int bonds = walker.bond_min + 2 * bond_bin + ((walker.bond_sum - walker.bond_min) & 1);
+				int spins = 2 * spin_bin - num_sites + ((walker.spin_sum + num_sites) & 1);
+				if (bonds < cuts[window] || bonds >= cuts[window + 1]) continue;
+
+				dos.bond_sums.push_back(bonds);
+				dos.spin_sums.push_back(spins);
+				dos.log_g    .push_back(value + shifts[window]);
+			}
+		}
+	}
+
+	return dos;
+}
+
+#endif // ISING_MODEL_WANG_LANDAU_HPP_INCLUDED
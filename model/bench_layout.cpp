@@ -0,0 +1,113 @@
+//======================================//
+// LATTICE LAYOUT BENCHMARK             //
+// No Copyright. Vladislav Aleinik 2020 //
+//======================================//
+
+#include "Model.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+#include <time.h>
+
+//===========//
+// Benchmark //
+//===========//
+
+double seconds_now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+enum SweepPattern
+{
+	PATTERN_RANDOM = 0,
+	PATTERN_TILED  = 1
+};
+
+// Returns nanoseconds per Metropolis step:
+double time_layout(LatticeLayout layout, Boundary boundary, SweepPattern pattern, int size, unsigned steps)
+{
+	// Low temperature keeps the exp() out of the measurement as much as possible:
+	Lattice lattice{size, size, size, 1.0, 1.0, 0.0, layout, GEOMETRY_SIMPLE_CUBIC, 1, boundary};
+	lattice.init_with_randoms();
+
+	// Warm up caches and TLB:
+	if (pattern == PATTERN_RANDOM) lattice.metropolis_sweep      (steps / 4);
+	else                           lattice.metropolis_sweep_tiled(steps / 4);
+
+	double start = seconds_now();
+
+	if (pattern == PATTERN_RANDOM) lattice.metropolis_sweep      (steps);
+	else                           lattice.metropolis_sweep_tiled(steps);
+
+	double finish = seconds_now();
+
+	return 1e9 * (finish - start) / steps;
+}
+
+//======//
+// Main //
+//======//
+
+int main(int argc, char** argv)
+{
+	if (argc > 2)
+	{
+		fprintf(stderr, "[BENCH-LAYOUT] Expected input: bench_layout [max-lattice-size]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	int max_size = 256;
+	if (argc == 2)
+	{
+		char* endptr = argv[1];
+		max_size = strtol(argv[1], &endptr, 10);
+		if (*argv[1] == '\0' || *endptr != '\0' || max_size < 4)
+		{
+			fprintf(stderr, "[BENCH-LAYOUT] Unable to parse maximum lattice size!\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Helical boundaries only exist for the row-major layout:
+	const int NUM_VARIANTS = 4;
+	const LatticeLayout layouts   [NUM_VARIANTS] = {LAYOUT_ROW_MAJOR,  LAYOUT_MORTON,     LAYOUT_BRICK,      LAYOUT_ROW_MAJOR};
+	const Boundary      boundaries[NUM_VARIANTS] = {BOUNDARY_PERIODIC, BOUNDARY_PERIODIC, BOUNDARY_PERIODIC, BOUNDARY_HELICAL};
+
+	printf("# size\tlayout\tboundary\tpattern\tns_per_step\tstorage_bytes\n");
+
+	for (int size = 8; size <= max_size; size *= 2)
+	{
+		unsigned volume = size * size * size;
+		unsigned steps  = volume < (1u << 22)? (1u << 24) : 4 * volume;
+
+		for (int pattern = PATTERN_RANDOM; pattern <= PATTERN_TILED; ++pattern)
+		{
+			int    best_variant = 0;
+			double best_time    = 0.0;
+
+			for (int var = 0; var < NUM_VARIANTS; ++var)
+			{
+				double ns_per_step = time_layout(layouts[var], boundaries[var], static_cast<SweepPattern>(pattern), size, steps);
+
+				Lattice probe{size, size, size, 1.0, 1.0, 0.0, layouts[var]};
+				printf("%d\t%s\t%s\t%s\t%.3f\t%zu\n", size, lattice_layout_name(layouts[var]), boundary_name(boundaries[var]),
+				       pattern == PATTERN_RANDOM? "random" : "tiled", ns_per_step, probe.storage_size());
+
+				if (var == 0 || ns_per_step < best_time)
+				{
+					best_time    = ns_per_step;
+					best_variant = var;
+				}
+			}
+
+			printf("# best for size %d (%s): %s, %s\n", size, pattern == PATTERN_RANDOM? "random" : "tiled",
+			       lattice_layout_name(layouts[best_variant]), boundary_name(boundaries[best_variant]));
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
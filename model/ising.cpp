@@ -0,0 +1,382 @@
+//======================================//
+// EMBEDDABLE LIBRARY                   //
+// No Copyright. Vladislav Aleinik 2020 //
+//======================================//
+
+// The only translation unit of libising: the header-only model is compiled here
+// and everything but the C interface of ising.h stays hidden in the shared library.
+
+#include "ising.h"
+#include "Simulation.hpp"
+#include "ThreadCoreScalability.hpp"
+
+#include <climits>
+#include <new>
+#include <string>
+#include <vector>
+
+//================//
+// Error Handling //
+//================//
+
+static thread_local std::string last_error;
+
+static IsingStatus fail(IsingStatus status, const char* message)
+{
+	last_error = message;
+	return status;
+}
+
+int ising_api_version(void)
+{
+	return ISING_API_VERSION;
+}
+
+const char* ising_last_error(void)
+{
+	return last_error.c_str();
+}
+
+//==========//
+// Lattices //
+//==========//
+
+struct IsingLattice
+{
+	Lattice lattice;
+	double magnetic_moment;
+
+	IsingLattice(const IsingLatticeDesc* desc);
+};
+
+IsingLattice::IsingLattice(const IsingLatticeDesc* desc) :
+	lattice         (desc->sizes[0], desc->sizes[1], desc->sizes[2],
+	                 desc->interactivity * 1.6e-19 /*Joules*/, 0.0, 0.0,
+	                 static_cast<LatticeLayout>(desc->layout), static_cast<Geometry>(desc->geometry), desc->sizes[3]),
+	magnetic_moment (desc->magnetic_moment)
+{
+	// Lattices are handed out in the ordered state, so they can be swept right away:
+	lattice.init_spins(START_COLD_UP);
+}
+
+static IsingStatus check_lattice_desc(const IsingLatticeDesc* desc)
+{
+	if (desc == nullptr) return fail(ISING_INVALID_ARGUMENT, "Lattice description is null");
+
+	if (desc->layout < ISING_LAYOUT_ROW_MAJOR || desc->layout > ISING_LAYOUT_BRICK)
+	{
+		return fail(ISING_INVALID_ARGUMENT, "Unknown lattice layout");
+	}
+
+	if (desc->geometry < ISING_GEOMETRY_SQUARE || desc->geometry > ISING_GEOMETRY_HYPERCUBIC_4D)
+	{
+		return fail(ISING_INVALID_ARGUMENT, "Unknown lattice geometry");
+	}
+
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+	{
+		if (desc->sizes[axis] <= 0) return fail(ISING_INVALID_ARGUMENT, "Lattice sizes must be positive");
+	}
+
+	return ISING_OK;
+}
+
+IsingStatus ising_lattice_create(const IsingLatticeDesc* desc, IsingLattice** lattice)
+{
+	if (lattice == nullptr) return fail(ISING_INVALID_ARGUMENT, "Output pointer is null");
+	*lattice = nullptr;
+
+	IsingStatus status = check_lattice_desc(desc);
+	if (status != ISING_OK) return status;
+
+	try
+	{
+		*lattice = new IsingLattice(desc);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return fail(ISING_OUT_OF_MEMORY, "Unable to allocate lattice");
+	}
+	catch (const std::invalid_argument& error)
+	{
+		return fail(ISING_INVALID_ARGUMENT, error.what());
+	}
+	catch (const std::exception& error)
+	{
+		return fail(ISING_RUNTIME_ERROR, error.what());
+	}
+
+	return ISING_OK;
+}
+
+void ising_lattice_destroy(IsingLattice* lattice)
+{
+	delete lattice;
+}
+
+IsingStatus ising_lattice_init_random(IsingLattice* lattice)
+{
+	if (lattice == nullptr) return fail(ISING_INVALID_ARGUMENT, "Lattice is null");
+
+	lattice->lattice.init_with_randoms();
+	return ISING_OK;
+}
+
+IsingStatus ising_lattice_set_point(IsingLattice* lattice, double temperature, double field)
+{
+	if (lattice == nullptr) return fail(ISING_INVALID_ARGUMENT, "Lattice is null");
+	if (!(temperature > 0.0)) return fail(ISING_INVALID_ARGUMENT, "Temperature must be positive");
+
+	lattice->lattice.temperature = temperature * BOLTZMANN;
+	lattice->lattice.field       = field * lattice->magnetic_moment;
+	return ISING_OK;
+}
+
+IsingStatus ising_lattice_sweep(IsingLattice* lattice, uint64_t steps)
+{
+	if (lattice == nullptr) return fail(ISING_INVALID_ARGUMENT, "Lattice is null");
+	if (!(lattice->lattice.temperature > 0.0)) return fail(ISING_INVALID_ARGUMENT, "Temperature is not set");
+
+	for (uint64_t done = 0; done < steps;)
+	{
+		unsigned chunk = steps - done < UINT_MAX? static_cast<unsigned>(steps - done) : UINT_MAX;
+		lattice->lattice.metropolis_sweep(chunk);
+		done += chunk;
+	}
+
+	return ISING_OK;
+}
+
+double ising_lattice_average_spin(const IsingLattice* lattice)
+{
+	return lattice == nullptr? 0.0 : lattice->lattice.calculate_average_spin();
+}
+
+int64_t ising_lattice_bond_sum(const IsingLattice* lattice)
+{
+	return lattice == nullptr? 0 : lattice->lattice.calculate_bond_sum();
+}
+
+int64_t ising_lattice_total_spin(const IsingLattice* lattice)
+{
+	return lattice == nullptr? 0 : lattice->lattice.calculate_total_spin();
+}
+
+static void fill_spin_view(const Lattice& lattice, IsingSpinView* view)
+{
+	const LayoutTables& tables = lattice.get_layout_tables();
+
+	view->spins        = reinterpret_cast<const int8_t*>(lattice.data());
+	view->storage_size = lattice.storage_size();
+	lattice.get_sizes(view->sizes);
+
+	for (int axis = 0; axis < LATTICE_MAX_DIMS; ++axis)
+	{
+		// Tables start at coordinate -1:
+		view->offsets[axis] = tables.offsets[axis] + 1;
+
+		bool linear = lattice.get_layout() == LAYOUT_ROW_MAJOR && view->sizes[axis] > 1;
+		view->strides[axis] = linear? view->offsets[axis][1] - view->offsets[axis][0] : 0;
+	}
+}
+
+IsingStatus ising_lattice_view(const IsingLattice* lattice, IsingSpinView* view)
+{
+	if (lattice == nullptr || view == nullptr) return fail(ISING_INVALID_ARGUMENT, "Lattice or view is null");
+
+	fill_spin_view(lattice->lattice, view);
+	return ISING_OK;
+}
+
+//=======//
+// Scans //
+//=======//
+
+struct FlatHistogram
+{
+	std::vector<int32_t>  bond_sums;
+	std::vector<int32_t>  spin_sums;
+	std::vector<uint64_t> counts;
+};
+
+struct IsingScan
+{
+	unsigned num_samples;
+	std::vector<double> samples;
+
+	// Flattened once after the run so views can point into them:
+	std::vector<EnergyHistogram> histograms;
+	std::vector<FlatHistogram> flat_histograms;
+
+	SimulationTimes times;
+};
+
+struct ScanCallback
+{
+	IsingSampleCallback callback;
+	void* user_data;
+	double magnetic_moment;
+};
+
+static void forward_sample(const Lattice& lattice, unsigned sample, int thread_index,
+                           float temperature, float field, void* user_data)
+{
+	const ScanCallback* scan_callback = reinterpret_cast<const ScanCallback*>(user_data);
+
+	IsingSample info;
+	info.index         = sample;
+	info.thread_index  = thread_index;
+	info.temperature   = temperature;
+	info.field         = field;
+	info.magnetization = scan_callback->magnetic_moment * lattice.calculate_average_spin();
+	fill_spin_view(lattice, &info.spins);
+
+	scan_callback->callback(&info, scan_callback->user_data);
+}
+
+IsingStatus ising_scan_run(const IsingScanDesc* desc, IsingSampleCallback callback, void* user_data,
+                           IsingScan** scan)
+{
+	if (scan == nullptr || desc == nullptr) return fail(ISING_INVALID_ARGUMENT, "Scan description or output is null");
+	*scan = nullptr;
+
+	IsingStatus status = check_lattice_desc(&desc->lattice);
+	if (status != ISING_OK) return status;
+
+	if (!(desc->temp_step > 0.0) || !(desc->field_step > 0.0) || !(desc->temp_min > 0.0))
+	{
+		return fail(ISING_INVALID_ARGUMENT, "Scan ranges need positive steps and temperatures");
+	}
+
+	if (desc->num_threads <= 0 || desc->samples_per_point == 0)
+	{
+		return fail(ISING_INVALID_ARGUMENT, "Scan needs at least one thread and one sample per point");
+	}
+
+	// Shape problems are caught here with their own status, workers report runtime failures:
+	IsingLattice* probe = nullptr;
+	status = ising_lattice_create(&desc->lattice, &probe);
+	if (status != ISING_OK) return status;
+	ising_lattice_destroy(probe);
+
+	// Value-initialization leaves every optional feature disabled:
+	ComputationParams comp_info = ComputationParams();
+	comp_info.interactivity   = desc->lattice.interactivity * 1.6e-19 /*Joules*/;
+	comp_info.magnetic_moment = desc->lattice.magnetic_moment;
+	comp_info.size_x = desc->lattice.sizes[0];
+	comp_info.size_y = desc->lattice.sizes[1];
+	comp_info.size_z = desc->lattice.sizes[2];
+	comp_info.size_w = desc->lattice.sizes[3];
+	comp_info.layout   = static_cast<LatticeLayout>(desc->lattice.layout);
+	comp_info.geometry = static_cast<Geometry>(desc->lattice.geometry);
+
+	comp_info.temp_min   = desc->temp_min;
+	comp_info.temp_max   = desc->temp_max;
+	comp_info.temp_step  = desc->temp_step;
+	comp_info.field_min  = desc->field_min;
+	comp_info.field_max  = desc->field_max;
+	comp_info.field_step = desc->field_step;
+	comp_info.samples_per_point = desc->samples_per_point;
+	comp_info.steps_per_sample  = desc->steps_per_sample;
+
+	comp_info.histogram_measurements = desc->histogram_measurements;
+	comp_info.histogram_interval     = desc->histogram_interval != 0? desc->histogram_interval :
+	                                   comp_info.size_x * comp_info.size_y * comp_info.size_z * comp_info.size_w;
+
+	comp_info.num_threads = desc->num_threads;
+
+	ScanCallback scan_callback = {callback, user_data, desc->lattice.magnetic_moment};
+	if (callback != nullptr)
+	{
+		comp_info.sample_callback      = forward_sample;
+		comp_info.sample_callback_data = &scan_callback;
+	}
+
+	IsingScan* result = nullptr;
+	try
+	{
+		result = new IsingScan;
+		result->num_samples = count_samples(&comp_info);
+		result->samples.resize(3 * result->num_samples);
+		if (comp_info.histogram_measurements != 0) result->histograms.resize(result->num_samples);
+	}
+	catch (const std::bad_alloc&)
+	{
+		delete result;
+		return fail(ISING_OUT_OF_MEMORY, "Unable to allocate scan results");
+	}
+
+	comp_info.samples_to_save    = result->samples.data();
+	comp_info.histograms_to_save = result->histograms.empty()? nullptr : result->histograms.data();
+
+	// The library must not exit the host process, failures are reported instead:
+	CpuInfo online_harts;
+	const char* topology_error = nullptr;
+	if (!try_online_hardware_threads(&online_harts, &topology_error))
+	{
+		delete result;
+		return fail(ISING_RUNTIME_ERROR, topology_error);
+	}
+
+	std::string run_error;
+	if (!try_run_simulation(&comp_info, &online_harts, false, &result->times, &run_error))
+	{
+		delete result;
+		return fail(ISING_RUNTIME_ERROR, run_error.c_str());
+	}
+
+	// Flatten histograms for zero-copy views:
+	result->flat_histograms.resize(result->histograms.size());
+	for (size_t sample = 0; sample < result->histograms.size(); ++sample)
+	{
+		FlatHistogram& flat = result->flat_histograms[sample];
+		for (const auto& bin : result->histograms[sample].counts)
+		{
+			flat.bond_sums.push_back(EnergyHistogram::bond_sum(bin.first));
+			flat.spin_sums.push_back(EnergyHistogram::spin_sum(bin.first));
+			flat.counts   .push_back(bin.second);
+		}
+	}
+
+	*scan = result;
+	return ISING_OK;
+}
+
+void ising_scan_destroy(IsingScan* scan)
+{
+	delete scan;
+}
+
+unsigned ising_scan_num_samples(const IsingScan* scan)
+{
+	return scan == nullptr? 0 : scan->num_samples;
+}
+
+const double* ising_scan_samples(const IsingScan* scan)
+{
+	return scan == nullptr? nullptr : scan->samples.data();
+}
+
+IsingStatus ising_scan_histogram(const IsingScan* scan, unsigned sample, IsingHistogramView* view)
+{
+	if (scan == nullptr || view == nullptr) return fail(ISING_INVALID_ARGUMENT, "Scan or view is null");
+	if (sample >= scan->histograms.size()) return fail(ISING_INVALID_ARGUMENT, "No histogram recorded for sample");
+
+	const EnergyHistogram& histogram = scan->histograms[sample];
+	const FlatHistogram& flat = scan->flat_histograms[sample];
+
+	view->temperature      = histogram.temperature;
+	view->field            = histogram.field;
+	view->num_measurements = histogram.num_measurements;
+	view->num_bins         = flat.counts.size();
+	view->bond_sums        = flat.bond_sums.data();
+	view->spin_sums        = flat.spin_sums.data();
+	view->counts           = flat.counts.data();
+
+	return ISING_OK;
+}
+
+double ising_scan_real_time(const IsingScan* scan)
+{
+	return scan == nullptr? 0.0 : scan->times.real_time;
+}
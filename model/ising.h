@@ -0,0 +1,173 @@
+/* No Copyright. Vladislav Aleinik 2020 */
+#ifndef ISING_MODEL_ISING_H_INCLUDED
+#define ISING_MODEL_ISING_H_INCLUDED
+
+/*=================================================================*/
+/* C interface of libising: lattices, sweeps, threaded scans and   */
+/* read-only views of the internal buffers. Views are zero-copy:   */
+/* they point straight into library memory and stay valid until    */
+/* the owning object is destroyed (or the callback returns).       */
+/*=================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ISING_API_VERSION 1
+
+/* Only the functions below are exported from libising.so: */
+#define ISING_API __attribute__((visibility("default")))
+
+/*==============*/
+/* Status Codes */
+/*==============*/
+
+typedef enum
+{
+	ISING_OK               = 0,
+	ISING_INVALID_ARGUMENT = 1,
+	ISING_RUNTIME_ERROR    = 2,
+	ISING_OUT_OF_MEMORY    = 3
+} IsingStatus;
+
+ISING_API int ising_api_version(void);
+
+/* Message of the last failed call on the calling thread: */
+ISING_API const char* ising_last_error(void);
+
+/*===============*/
+/* Lattice Shape */
+/*===============*/
+
+/* Values match LatticeLayout and Geometry of the C++ headers: */
+typedef enum
+{
+	ISING_LAYOUT_ROW_MAJOR = 0,
+	ISING_LAYOUT_MORTON    = 1,
+	ISING_LAYOUT_BRICK     = 2
+} IsingLayout;
+
+typedef enum
+{
+	ISING_GEOMETRY_SQUARE        = 0,
+	ISING_GEOMETRY_TRIANGULAR    = 1,
+	ISING_GEOMETRY_SIMPLE_CUBIC  = 2,
+	ISING_GEOMETRY_BCC           = 3,
+	ISING_GEOMETRY_FCC           = 4,
+	ISING_GEOMETRY_HYPERCUBIC_4D = 5
+} IsingGeometry;
+
+typedef struct
+{
+	int sizes[4];              /* x, y, z, w; unused axes must be 1 */
+	IsingLayout   layout;
+	IsingGeometry geometry;
+	double interactivity;      /* Electronvolts, as in config files */
+	double magnetic_moment;    /* Joules per unit of field */
+} IsingLatticeDesc;
+
+/* Site (x, y, z, w) is spins[offsets[0][x] + offsets[1][y] + offsets[2][z] + offsets[3][w]].
+ * Offset tables accept coordinates -1 .. size (periodic halo).
+ * For the row-major layout strides[] describe the buffer directly (e.g. for Python's buffer protocol),
+ * for other layouts they are 0. */
+typedef struct
+{
+	const int8_t* spins;
+	size_t storage_size;
+	int sizes[4];
+	const int* offsets[4];
+	ptrdiff_t strides[4];
+} IsingSpinView;
+
+/*==========*/
+/* Lattices */
+/*==========*/
+
+typedef struct IsingLattice IsingLattice;
+
+ISING_API IsingStatus ising_lattice_create(const IsingLatticeDesc* desc, IsingLattice** lattice);
+ISING_API void        ising_lattice_destroy(IsingLattice* lattice);
+
+ISING_API IsingStatus ising_lattice_init_random(IsingLattice* lattice);
+
+/* Temperature in Kelvin, field in the units of the magnetic moment: */
+ISING_API IsingStatus ising_lattice_set_point(IsingLattice* lattice, double temperature, double field);
+
+ISING_API IsingStatus ising_lattice_sweep(IsingLattice* lattice, uint64_t steps);
+
+ISING_API double  ising_lattice_average_spin(const IsingLattice* lattice);
+ISING_API int64_t ising_lattice_bond_sum    (const IsingLattice* lattice);
+ISING_API int64_t ising_lattice_total_spin  (const IsingLattice* lattice);
+
+ISING_API IsingStatus ising_lattice_view(const IsingLattice* lattice, IsingSpinView* view);
+
+/*=======*/
+/* Scans */
+/*=======*/
+
+typedef struct
+{
+	IsingLatticeDesc lattice;
+
+	/* Half-open ranges [min, max) as in the T/H config lines: */
+	double  temp_min,  temp_max,  temp_step;
+	double field_min, field_max, field_step;
+	unsigned samples_per_point;
+	unsigned steps_per_sample;
+
+	/* Energy/magnetization histograms after every sample (0 disables): */
+	unsigned histogram_measurements;
+	unsigned histogram_interval;       /* 0 means the lattice volume */
+
+	int num_threads;
+} IsingScanDesc;
+
+typedef struct
+{
+	unsigned index;
+	int thread_index;
+	double temperature;
+	double field;
+	double magnetization;              /* magnetic_moment * average spin */
+	IsingSpinView spins;               /* Valid only during the callback */
+} IsingSample;
+
+/* Runs on worker threads, concurrently with other samples: */
+typedef void (*IsingSampleCallback)(const IsingSample* sample, void* user_data);
+
+/* Histogram of one sample as parallel arrays of (bond sum, spin sum) bins: */
+typedef struct
+{
+	double temperature;
+	double field;
+	uint64_t num_measurements;
+	size_t num_bins;
+	const int32_t* bond_sums;
+	const int32_t* spin_sums;
+	const uint64_t* counts;
+} IsingHistogramView;
+
+typedef struct IsingScan IsingScan;
+
+/* Blocks until the whole scan is done; threads are pinned like in the model driver: */
+ISING_API IsingStatus ising_scan_run(const IsingScanDesc* desc, IsingSampleCallback callback, void* user_data,
+                                     IsingScan** scan);
+ISING_API void        ising_scan_destroy(IsingScan* scan);
+
+ISING_API unsigned ising_scan_num_samples(const IsingScan* scan);
+
+/* Rows of (T, H, magnetization), num_samples x 3: */
+ISING_API const double* ising_scan_samples(const IsingScan* scan);
+
+ISING_API IsingStatus ising_scan_histogram(const IsingScan* scan, unsigned sample, IsingHistogramView* view);
+
+ISING_API double ising_scan_real_time(const IsingScan* scan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ISING_MODEL_ISING_H_INCLUDED */
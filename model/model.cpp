@@ -3,147 +3,12 @@
 // No Copyright. Vladislav Aleinik 2020 //
 //======================================//
 
-#include "Model.hpp"
+#include "Simulation.hpp"
 #include "ThreadCoreScalability.hpp"
 
 // #include "vendor/cnpy/cnpy.h"
 
 #include <signal.h>
-#include <sys/times.h>
-
-//==========================//
-// Parse Configuration File //
-//==========================//
-
-struct ComputationParams
-{
-	// Computation parameters:
-	float interactivity;
-	float magnetic_moment;
-	int size_x, size_y, size_z;
-
-	// Sampling parameters:
-	float  temp_min,  temp_max,  temp_step;
-	float field_min, field_max, field_step;
-	unsigned samples_per_point;
-	unsigned steps_per_sample;
-	unsigned steps_per_render_frame;
-
-	// Threading parameters:
-	int num_threads;
-
-	// Place to save samples:
-	double* samples_to_save;
-};
-
-ComputationParams parse_config_file(const char* config_filename)
-{
-	FILE* config_file = std::fopen(config_filename, "r");
-	if (config_file == nullptr)
-	{
-		fprintf(stderr, "[ISING-MODEL] Unable to open config file!\n");
-		exit(EXIT_FAILURE);
-	}
-
-	ComputationParams comp_info;
-
-	// Model parameters:
-	comp_info.interactivity   = 1.0;
-	comp_info.magnetic_moment = 1.0;
-	comp_info.size_x = 20;
-	comp_info.size_y = 20;
-	comp_info.size_z = 20;
-
-	fscanf(config_file,   "interactivity %f\n", &comp_info.interactivity);
-	fscanf(config_file, "magnetic_moment %f\n", &comp_info.magnetic_moment);
-	fscanf(config_file,  "size (%u, %u, %u)\n", &comp_info.size_x, &comp_info.size_y, &comp_info.size_z);
-
-	comp_info.interactivity *= 1.6e-19 /*Joules*/; 
-
-	// Sampling parameters:
-	comp_info.temp_min  = 100.0;
-	comp_info.temp_max  = 100.0;
-	comp_info.temp_step = 100.0;
-	comp_info.field_min   = 0.0;
-	comp_info.field_max   = 0.0;
-	comp_info. field_step = 0.0;
-
-	comp_info.samples_per_point      = 1;
-	comp_info.steps_per_sample       = 10000000;
-	comp_info.steps_per_render_frame = 50000;
-
-	fscanf(config_file, "T [%f : %f : %f]\n",  &comp_info.temp_min,  &comp_info.temp_max,  &comp_info.temp_step);
-	fscanf(config_file, "H [%f : %f : %f]\n", &comp_info.field_min, &comp_info.field_max, &comp_info.field_step);
-	fscanf(config_file,      "samples_per_point %u\n", &comp_info.samples_per_point);
-	fscanf(config_file,       "steps_per_sample %u\n", &comp_info.steps_per_sample);
-	fscanf(config_file, "steps_per_render_frame %u\n", &comp_info.steps_per_render_frame);
-
-	fclose(config_file);
-
-	return comp_info;
-}
-
-//==================//
-// Computation Core //
-//==================//
-
-struct ThreadParams
-{
-	// Data necessary to init calculation:
-	int thread_index;
-	const ComputationParams* computation_parameters;
-};
-
-// Code to be executed in a thread:
-void* compute_ising_model_sample(void* arg)
-{
-	// Check argument:
-	ThreadParams* thr_info = reinterpret_cast<ThreadParams*>(arg);
-
-	if (thr_info                                          == nullptr ||
-		thr_info->computation_parameters                  == nullptr ||
-		thr_info->computation_parameters->samples_to_save == nullptr)
-	{
-		fprintf(stderr, "[ISING-MODEL] Computation parameter is invailid!\n");
-		exit(EXIT_FAILURE);
-	}
-
-	const ComputationParams* comp_info = thr_info->computation_parameters;
-
-	// Initialize lattice for computations:
-	Lattice lattice{comp_info->size_x, comp_info->size_y, comp_info->size_z, comp_info->interactivity, 0.0, 0.0};
-
-	// Calculate:
-	int total_sample = 0;
-	for (float  temp_cur = comp_info-> temp_min;  temp_cur < comp_info-> temp_max;  temp_cur += comp_info-> temp_step) {
-	for (float field_cur = comp_info->field_min; field_cur < comp_info->field_max; field_cur += comp_info->field_step)
-	{
-		for (unsigned sample = 0; sample < comp_info->samples_per_point; ++sample, ++total_sample)
-		{
-			// Drop computation if it belongs to other thread:
-			if (total_sample % comp_info->num_threads != thr_info->thread_index) continue;
-
-			// Printout computation step:
-			// printf("[ISING-MODEL] (%02d) Computing for T=%6.1lf H=%5.1lf sample=%02d/%02d\n",
-			//        thr_info->thread_index, temp_cur, field_cur, sample + 1, comp_info->samples_per_point);
-
-			// Initialize lattice for exact computation:
-			lattice.temperature = temp_cur  * 1.38e-23;
-			lattice.field       = field_cur * comp_info->magnetic_moment;
-			lattice.init_with_randoms();
-
-			// Perform computation:
-			lattice.metropolis_sweep(comp_info->steps_per_sample);
-
-			// Aggregate results:
-			comp_info->samples_to_save[3 * total_sample + 0] = temp_cur;
-			comp_info->samples_to_save[3 * total_sample + 1] = field_cur;
-			comp_info->samples_to_save[3 * total_sample + 2] = comp_info->magnetic_moment * lattice.calculate_average_spin();
-		}
-	}}
-
-	return nullptr;
-}
 
 //======//
 // Main //
@@ -176,7 +41,11 @@ int main(int argc, char** argv)
 
 	ComputationParams comp_info = parse_config_file(config_filename);
 	comp_info.num_threads = num_threads;
-	comp_info.samples_to_save = nullptr; /* Will be filled later */
+	comp_info.samples_to_save    = nullptr; /* Will be filled later */
+	comp_info.histograms_to_save = nullptr; /* Will be filled later */
+	comp_info.snapshot_writer    = nullptr; /* Will be filled later */
+	comp_info.progress           = nullptr; /* Owned by run_simulation() */
+	comp_info.sample_callback    = nullptr;
 
 	//======================//
 	// Acquire CPU Topology //
@@ -189,15 +58,7 @@ int main(int argc, char** argv)
 	//====================//
 
 	// Allocate data aggregation array:
-	unsigned num_samples = 0;
-	for (float  temp_cur = comp_info. temp_min;  temp_cur < comp_info. temp_max;  temp_cur += comp_info. temp_step) {
-	for (float field_cur = comp_info.field_min; field_cur < comp_info.field_max; field_cur += comp_info.field_step) 
-	{
-		for (unsigned sample = 0; sample < comp_info.samples_per_point; ++sample)
-		{
-			num_samples += 1;
-		}
-	}}
+	unsigned num_samples = count_samples(&comp_info);
 
 	double* samples_to_save = (double*) calloc(3 * num_samples, sizeof(*samples_to_save));
 	if (samples_to_save == nullptr)
@@ -208,80 +69,67 @@ int main(int argc, char** argv)
 
 	comp_info.samples_to_save = samples_to_save;
 
-	// Allocate thread parameters array:
-	ThreadParams* thread_params = (ThreadParams*) calloc(num_threads, sizeof(*thread_params));
-	if (thread_params == nullptr)
+	// Allocate histograms for reweighting:
+	EnergyHistogram* histograms_to_save = nullptr;
+	if (comp_info.histogram_measurements != 0)
 	{
-		fprintf(stderr, "[ISING-MODEL] Unable to allocate memory for thread parameters!\n");
-		exit(EXIT_FAILURE);
-	} 
-
-	for (int i = 0; i < num_threads; ++i)
-	{
-		thread_params[i].thread_index = i;
-		thread_params[i].computation_parameters = &comp_info;
+		histograms_to_save = new EnergyHistogram[num_samples];
 	}
 
-	// Data necessary to wait for thread completion:
-	pthread_t* thread_table = (pthread_t*) calloc(num_threads, sizeof(*thread_table));
-	if (thread_table == nullptr)
-	{
-		fprintf(stderr, "[ISING-MODEL] Unable to allocate thread table!\n");
-		exit(EXIT_FAILURE);
-	} 
-
-	//=========================//
-	// Start Time Measurements //
-	//=========================//
-
-	struct tms time_start;
-	long real_time_start = times(&time_start);
-
-	long ticks_in_one_second = sysconf(_SC_CLK_TCK);
-
-	//====================//
-	// Start Calculations //
-	//====================//
+	comp_info.histograms_to_save = histograms_to_save;
 
-	for (int thr = 0; thr < num_threads; ++thr)
+	// Start snapshot stream:
+	SnapshotWriter* snapshot_writer = nullptr;
+	if (comp_info.snapshot_interval != 0)
 	{
-		// Aquire harware threads to run on:
-		cpu_set_t availible_harts = assign_hardware_thread(&online_harts);
-
-		// Start computation:
-		create_anchored_thread(&thread_table[thr],
-			                   compute_ising_model_sample,
-		                       &thread_params[thr],
-		                       &availible_harts);
+		int sizes[LATTICE_MAX_DIMS] = {comp_info.size_x, comp_info.size_y, comp_info.size_z, comp_info.size_w};
+		try
+		{
+			snapshot_writer = new SnapshotWriter(comp_info.snapshot_output, sizes,
+			                                     comp_info.snapshot_keyframe_interval, comp_info.snapshot_delta);
+		}
+		catch (const std::exception& error)
+		{
+			fprintf(stderr, "[ISING-MODEL] %s\n", error.what());
+			exit(EXIT_FAILURE);
+		}
 	}
 
-	//========================//
-	// Spawn Parasite Threads //
-	//========================//
-
-	fill_with_parasite_threads(&online_harts);
+	comp_info.snapshot_writer = snapshot_writer;
 
-	//=====================//
-	// Wair For Completion //
-	//=====================//
+	//=================//
+	// Run Simulations //
+	//=================//
 
-	for (int thr = 0; thr < num_threads; ++thr)
+	SimulationTimes sim_times;
+	std::vector<WangLandauWalker*> walkers;
+	if (comp_info.simulation == SIMULATION_WANG_LANDAU)
 	{
-		if (pthread_join(thread_table[thr], nullptr) != 0)
+		sim_times = run_wang_landau(&comp_info, &online_harts, &walkers);
+
+		for (const WangLandauWalker* walker : walkers)
 		{
-			fprintf(stderr, "[ISING-MODEL] Unable to join thread!\n");
-			exit(EXIT_FAILURE);
+			printf("[ISING-MODEL] Wang-Landau window [%d, %d]: %u stages, ln f = %.3e\n",
+			       walker->bond_min, walker->bond_max, walker->stage, walker->log_f);
 		}
 	}
+	else
+	{
+		print_parallel_plan(stdout, "[ISING-MODEL]", plan_simulation(&comp_info));
+
+		sim_times = run_simulation(&comp_info, &online_harts, true);
+	}
 
 	printf("[ISING-MODEL] Execution finished!\n");
 
-	//==========================//
-	// Finish Time Measurements //
-	//==========================//
+	// Flush the snapshot stream:
+	if (snapshot_writer != nullptr)
+	{
+		delete snapshot_writer;
+		comp_info.snapshot_writer = nullptr;
 
-	struct tms time_finish;
-	long real_time_finish = times(&time_finish);
+		printf("[ISING-MODEL] Snapshots saved!\n");
+	}
 
 	//===============================================//
 	// Aggregate results in python-compatible format //
@@ -291,6 +139,56 @@ int main(int argc, char** argv)
 
 	printf("[ISING-MODEL] Data aggregated!\n");
 
+	//=======================//
+	// Histogram Reweighting //
+	//=======================//
+
+	if (histograms_to_save != nullptr && comp_info.reweight_output[0] != '\0')
+	{
+		save_reweighted_observables(&comp_info, histograms_to_save, num_samples);
+
+		printf("[ISING-MODEL] Reweighted observables saved!\n");
+	}
+
+	//===================//
+	// Density of States //
+	//===================//
+
+	if (!walkers.empty())
+	{
+		std::vector<const WangLandauWalker*> windows(walkers.begin(), walkers.end());
+
+		DensityOfStates dos;
+		try
+		{
+			dos = merge_wang_landau_windows(windows);
+
+			// Walks over the whole bond range are not cut anywhere:
+			if (comp_info.wang_landau.bond_min_share <= -1.0) dos.cut_min = INT32_MIN;
+			if (comp_info.wang_landau.bond_max_share >=  1.0) dos.cut_max = INT32_MAX;
+		}
+		catch (const std::exception& error)
+		{
+			fprintf(stderr, "[ISING-MODEL] %s\n", error.what());
+			exit(EXIT_FAILURE);
+		}
+
+		if (comp_info.wang_landau_output[0] != '\0')
+		{
+			save_density_of_states(comp_info.wang_landau_output, dos);
+
+			printf("[ISING-MODEL] Density of states saved!\n");
+		}
+
+		if (comp_info.reweight_output[0] != '\0')
+		{
+			std::vector<std::vector<DensityOfStates>> sets(1, std::vector<DensityOfStates>(1, dos));
+			write_reweighted_table(&comp_info, sets, std::vector<EnergyHistogram>());
+
+			printf("[ISING-MODEL] Reweighted observables saved!\n");
+		}
+	}
+
 	//==========//
 	// Log Data //
 	//==========//
@@ -302,15 +200,11 @@ int main(int argc, char** argv)
 		exit(EXIT_FAILURE);
 	}
 
-	float   user_time = 1.0 * (time_finish.tms_utime - time_start.tms_utime) / ticks_in_one_second;
-	float kernel_time = 1.0 * (time_finish.tms_stime - time_start.tms_stime) / ticks_in_one_second;
-	float   real_time = 1.0 * (real_time_finish      -      real_time_start) / ticks_in_one_second;
-
-	fprintf(log_file, "[LOG] Userspace   time = %03.3f sec\n",   user_time);
-	fprintf(log_file, "[LOG] Kernelspace time = %03.3f sec\n", kernel_time);
-	fprintf(log_file, "[LOG] Real        time = %03.3f sec\n",   real_time);
+	fprintf(log_file, "[LOG] Userspace   time = %03.3f sec\n", sim_times.  user_time);
+	fprintf(log_file, "[LOG] Kernelspace time = %03.3f sec\n", sim_times.kernel_time);
+	fprintf(log_file, "[LOG] Real        time = %03.3f sec\n", sim_times.  real_time);
 	fprintf(log_file, "[LOG] Number of threads = %d\n", num_threads);
-	fprintf(log_file, "[LOG] Time x Threads = %03.3f sec\n\n", real_time * num_threads);
+	fprintf(log_file, "[LOG] Time x Threads = %03.3f sec\n\n", sim_times.real_time * num_threads);
 	
 	fclose(log_file);
 
@@ -321,8 +215,8 @@ int main(int argc, char** argv)
 	//======================//
 
 	free(samples_to_save);
-	free(thread_params);
-	free(thread_table);
+	delete[] histograms_to_save;
+	for (WangLandauWalker* walker : walkers) delete walker;
 
 	return EXIT_SUCCESS;
 }
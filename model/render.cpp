@@ -149,7 +149,8 @@ int main(int argc, char** argv)
 	lattice.init_with_randoms();
 
 	double saved_magnetization = 0.0;
-	for (size_t iter = 0; true; iter = (iter + 1) % 10)
+	bool running = true;
+	for (size_t iter = 0; running; iter = (iter + 1) % 10)
 	{
 		// Set calculation parameters:
 		lattice.temperature =  temp_cur * 1.38e-23;
@@ -179,7 +180,7 @@ int main(int argc, char** argv)
 		// Interaction:
 		char cur_cmd;
 		for (int bytes_read = read(STDIN_FILENO, &cur_cmd, 1);
-			bytes_read != 0 && cur_cmd != '\n';
+			bytes_read > 0 && cur_cmd != '\n';
 			bytes_read = read(STDIN_FILENO, &cur_cmd, 1))
 		{
 			switch (cur_cmd)
@@ -196,6 +197,9 @@ int main(int argc, char** argv)
 				case 'd':
 					field_cur += 1.0;
 					break;
+				case 'q':
+					running = false;
+					break;
 			}
 		}
 
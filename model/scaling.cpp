@@ -0,0 +1,197 @@
+//======================================//
+// THREAD SCALING EXPERIMENT            //
+// No Copyright. Vladislav Aleinik 2020 //
+//======================================//
+
+#include "Simulation.hpp"
+#include "ThreadCoreScalability.hpp"
+
+#include <atomic>
+
+//=======================//
+// Machine State Sampler //
+//=======================//
+
+const unsigned SAMPLER_PERIOD_MS = 100;
+
+struct SamplerParams
+{
+	// Input:
+	const CpuInfo* cpu_info;
+	cpu_set_t busy_harts;
+	std::atomic<bool> stop;
+
+	// Output:
+	double   freq_mhz_sum;
+	unsigned freq_samples;
+	float    max_temp_celsius;
+};
+
+void* sample_machine_state_periodically(void* arg)
+{
+	SamplerParams* sampler = reinterpret_cast<SamplerParams*>(arg);
+
+	while (not sampler->stop.load(std::memory_order_relaxed))
+	{
+		MachineState state = sample_machine_state(sampler->cpu_info);
+
+		float freq_mhz = average_frequency_mhz(&state, &sampler->busy_harts, sampler->cpu_info->hart_arr_size);
+		if (freq_mhz > 0.0)
+		{
+			sampler->freq_mhz_sum += freq_mhz;
+			sampler->freq_samples += 1;
+		}
+
+		if (state.temp_sensors != 0 && state.max_temp_celsius > sampler->max_temp_celsius)
+		{
+			sampler->max_temp_celsius = state.max_temp_celsius;
+		}
+
+		struct timespec period = {0, SAMPLER_PERIOD_MS * 1000000L};
+		nanosleep(&period, nullptr);
+	}
+
+	return nullptr;
+}
+
+//======//
+// Main //
+//======//
+
+int main(int argc, char** argv)
+{
+	if (argc != 4)
+	{
+		fprintf(stderr, "[ISING-SCALING] Expected input: scaling <max-threads> <config-file> <table-file>\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Parse number of threads:
+	char* endptr = argv[1];
+	int max_threads = strtol(argv[1], &endptr, 10);
+	if (*argv[1] == '\0' || *endptr != '\0' || max_threads <= 0)
+	{
+		fprintf(stderr, "[ISING-SCALING] Unable to parse maximum number of threads!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const char* config_filename = argv[2];
+	const char*  table_filename = argv[3];
+
+	//=======//
+	// Setup //
+	//=======//
+
+	ComputationParams comp_info = parse_config_file(config_filename);
+
+	CpuInfo online_harts = online_hardware_threads();
+
+	unsigned num_samples = count_samples(&comp_info);
+	double total_steps = 1.0 * num_samples * comp_info.steps_per_sample;
+
+	double* samples_to_save = (double*) calloc(3 * num_samples, sizeof(*samples_to_save));
+	if (samples_to_save == nullptr)
+	{
+		fprintf(stderr, "[ISING-SCALING] Unable to allocate memory for data samples!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	comp_info.samples_to_save    = samples_to_save;
+	comp_info.histograms_to_save = nullptr;
+	comp_info.snapshot_writer    = nullptr;
+	comp_info.progress           = nullptr;
+	comp_info.sample_callback    = nullptr;
+
+	FILE* table_file = fopen(table_filename, "w");
+	if (table_file == nullptr)
+	{
+		fprintf(stderr, "[ISING-SCALING] Unable to open table file!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const char* header =
+		"# threads\treal_sec\tuser_sec\tsteps_per_sec\tspeedup\tefficiency"
+		"\tmean_freq_mhz\tmax_temp_c\tsteps_per_ghz_sec\tnorm_speedup\tnorm_efficiency\tsteady\n";
+	fputs(header, table_file);
+	fputs(header, stdout);
+
+	//===============//
+	// Thread Ladder //
+	//===============//
+
+	double base_throughput      = 0.0;
+	double base_norm_throughput = 0.0;
+
+	for (int num_threads = 1; num_threads <= max_threads; ++num_threads)
+	{
+		printf("[ISING-SCALING] Waiting for thermal steady state\n");
+		bool steady = wait_for_thermal_steady_state(&online_harts, 1.0, 5000, 120000);
+
+		// Find out which harts the run is going to occupy:
+		CpuInfo run_harts = online_harts;
+		CpuInfo probe     = online_harts;
+
+		SamplerParams sampler;
+		sampler.cpu_info = &online_harts;
+		CPU_ZERO(&sampler.busy_harts);
+		for (int thr = 0; thr < num_threads; ++thr)
+		{
+			cpu_set_t hart = assign_hardware_thread(&probe);
+			CPU_OR(&sampler.busy_harts, &sampler.busy_harts, &hart);
+		}
+		sampler.stop.store(false);
+		sampler.freq_mhz_sum     = 0.0;
+		sampler.freq_samples     = 0;
+		sampler.max_temp_celsius = 0.0;
+
+		pthread_t sampler_thread;
+		if (pthread_create(&sampler_thread, nullptr, sample_machine_state_periodically, &sampler) != 0)
+		{
+			fprintf(stderr, "[ISING-SCALING] Unable to create sampler thread!\n");
+			exit(EXIT_FAILURE);
+		}
+
+		// Run without parasite threads: the sampler measures what they used to fake.
+		comp_info.num_threads = num_threads;
+		SimulationTimes sim_times = run_simulation(&comp_info, &run_harts, false);
+
+		sampler.stop.store(true);
+		if (pthread_join(sampler_thread, nullptr) != 0)
+		{
+			fprintf(stderr, "[ISING-SCALING] Unable to join sampler thread!\n");
+			exit(EXIT_FAILURE);
+		}
+
+		// Derive metrics:
+		float real_time = sim_times.real_time > 0.0? sim_times.real_time : 1e-3;
+		double throughput = total_steps / real_time;
+
+		double mean_freq_mhz = sampler.freq_samples == 0? 0.0 : sampler.freq_mhz_sum / sampler.freq_samples;
+		double norm_throughput = mean_freq_mhz > 0.0? throughput / (mean_freq_mhz / 1000.0) : throughput;
+
+		if (num_threads == 1)
+		{
+			base_throughput      = throughput;
+			base_norm_throughput = norm_throughput;
+		}
+
+		double speedup      = throughput      / base_throughput;
+		double norm_speedup = norm_throughput / base_norm_throughput;
+
+		char row[512];
+		snprintf(row, sizeof(row), "%d\t%.3f\t%.3f\t%.4e\t%.3f\t%.3f\t%.1f\t%.1f\t%.4e\t%.3f\t%.3f\t%d\n",
+		         num_threads, sim_times.real_time, sim_times.user_time, throughput,
+		         speedup, speedup / num_threads, mean_freq_mhz, sampler.max_temp_celsius,
+		         norm_throughput, norm_speedup, norm_speedup / num_threads, steady? 1 : 0);
+
+		fputs(row, table_file);
+		fputs(row, stdout);
+		fflush(table_file);
+	}
+
+	fclose(table_file);
+
+	free(samples_to_save);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+//======================================//
+// SNAPSHOT STREAM EXTRACTION           //
+// No Copyright. Vladislav Aleinik 2020 //
+//======================================//
+
+#include "Snapshot.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+
+//======//
+// Main //
+//======//
+
+int main(int argc, char** argv)
+{
+	if (argc != 2 && argc != 4)
+	{
+		fprintf(stderr, "[SNAPSHOT] Expected input: snapshot_extract <stream-prefix> [<frame> <raw-output-file>]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	try
+	{
+		SnapshotReader reader{argv[1]};
+		const SnapshotIndexHeader& header = reader.get_header();
+
+		std::vector<int8_t> spins(header.num_sites);
+
+		//=================//
+		// List All Frames //
+		//=================//
+
+		if (argc == 2)
+		{
+			printf("# size (%d, %d, %d, %d), %llu frames\n", header.sizes[0], header.sizes[1], header.sizes[2], header.sizes[3],
+			       static_cast<unsigned long long>(reader.num_frames()));
+			printf("# entry\tsample\tframe\tstep\tT\tH\tkeyframe\tbytes\taverage_spin\n");
+
+			for (uint64_t entry = 0; entry < reader.num_frames(); ++entry)
+			{
+				const SnapshotIndexEntry& record = reader.get_entry(entry);
+				reader.read_spins(entry, spins.data());
+
+				long spin_sum = 0;
+				for (int8_t spin : spins) spin_sum += spin;
+
+				printf("%llu\t%u\t%u\t%llu\t%.3f\t%.3f\t%d\t%u\t%.6f\n",
+				       static_cast<unsigned long long>(entry), record.sample, record.frame,
+				       static_cast<unsigned long long>(record.step), record.temperature, record.field,
+				       (record.flags & SNAPSHOT_FLAG_KEYFRAME)? 1 : 0, record.compressed_bytes,
+				       1.0 * spin_sum / header.num_sites);
+			}
+
+			return EXIT_SUCCESS;
+		}
+
+		//===================//
+		// Extract One Frame //
+		//===================//
+
+		char* endptr = argv[2];
+		unsigned long long entry = strtoull(argv[2], &endptr, 10);
+		if (*argv[2] == '\0' || *endptr != '\0' || entry >= reader.num_frames())
+		{
+			fprintf(stderr, "[SNAPSHOT] Invalid frame number!\n");
+			exit(EXIT_FAILURE);
+		}
+
+		reader.read_spins(entry, spins.data());
+
+		FILE* output = fopen(argv[3], "wb");
+		if (output == nullptr || fwrite(spins.data(), 1, spins.size(), output) != spins.size())
+		{
+			fprintf(stderr, "[SNAPSHOT] Unable to write raw spins!\n");
+			exit(EXIT_FAILURE);
+		}
+
+		fclose(output);
+	}
+	catch (const std::exception& error)
+	{
+		fprintf(stderr, "[SNAPSHOT] %s\n", error.what());
+		exit(EXIT_FAILURE);
+	}
+
+	return EXIT_SUCCESS;
+}